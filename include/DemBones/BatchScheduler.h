@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+//               Dem Bones - Skinning Decomposition Library                  //
+//         Copyright (c) 2019, Electronic Arts. All rights reserved.         //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#ifndef DEM_BONES_BATCH_SCHEDULER
+#define DEM_BONES_BATCH_SCHEDULER
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace Dem
+{
+
+/** @class BatchScheduler BatchScheduler.h "DemBones/BatchScheduler.h"
+	@brief Run independent decompositions concurrently under a shared budget of threads
+	@details Each job runs in its own thread with an OpenMP team of threads(@p cost) threads, so small jobs run side by side with one or a few
+	threads while a large job gets the whole budget. The jobs are started from the most expensive one, each as soon as enough threads of the
+	budget are free, so the number of running threads never exceeds #nThreads. Nested parallel regions are disabled while the jobs run.
+*/
+class BatchScheduler {
+public:
+	//! Total number of threads shared by the jobs, @c default = maximum number of OpenMP threads
+	int nThreads;
+	//! Cost worth one thread, the number of threads of a job is its cost divided by this value, @c default = 1e6
+	double costPerThread;
+
+	/** Constructor
+		@param nThreads is the total number of threads, 0 = maximum number of OpenMP threads
+	*/
+	BatchScheduler(int nThreads=0): nThreads(nThreads), costPerThread(1e6) {
+#ifdef _OPENMP
+		if (this->nThreads<=0) this->nThreads=omp_get_max_threads();
+#endif
+		this->nThreads=std::max(this->nThreads, 1);
+	}
+
+	//! @return number of threads of a job of cost @p cost
+	int threads(double cost) const {
+		return (int)std::min(std::max(std::ceil(cost/costPerThread), 1.0), (double)nThreads);
+	}
+
+	/** Run all the jobs and wait for them, the first exception thrown by a job is rethrown after all the jobs have finished
+		@param[in] cost is the costs of the jobs, e.g. number of vertices times number of frames
+		@param[in] job(@p i, @p nt) runs the job @p i, it is called in a separate thread whose OpenMP team size is @p nt
+	*/
+	void run(const std::vector<double>& cost, const std::function<void(int, int)>& job) {
+		std::vector<int> order(cost.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return cost[a]>cost[b]; });
+
+#ifdef _OPENMP
+		int levels=omp_get_max_active_levels();
+		omp_set_max_active_levels(1);
+#endif
+
+		std::mutex mtx;
+		std::condition_variable freed;
+		int nFree=nThreads;
+		std::exception_ptr error;
+		std::vector<std::thread> workers;
+		workers.reserve(order.size());
+
+		for (int i: order) {
+			int nt=threads(cost[i]);
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				freed.wait(lock, [&]() { return nFree>=nt; });
+				nFree-=nt;
+			}
+			workers.emplace_back([&, i, nt]() {
+#ifdef _OPENMP
+				omp_set_num_threads(nt);
+#endif
+				try {
+					job(i, nt);
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(mtx);
+					if (!error) error=std::current_exception();
+				}
+				{
+					std::lock_guard<std::mutex> lock(mtx);
+					nFree+=nt;
+				}
+				freed.notify_one();
+			});
+		}
+		for (auto& t: workers) t.join();
+
+#ifdef _OPENMP
+		omp_set_max_active_levels(levels);
+#endif
+		if (error) std::rethrow_exception(error);
+	}
+};
+
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include <Eigen/Dense>
 #include <Eigen/StdVector>
 #include "Indexing.h"
+#include "Workspace.h"
 
 namespace Dem
 {
@@ -55,6 +56,9 @@ public:
 		}
 	}
 	
+	//! Workspace slots used by solve() with a Workspace, callers sharing the workspace use slots from #WS_END on
+	enum { WS_IDX=0, WS_P=0, WS_A, WS_L, WS_R, WS_QA, WS_B, WS_RHS, WS_Z, WS_END };
+
 	/** Solve the least squares problem
 		@param[in] aTa is the cross product matrix @f$ A^TA @f$
 		@param[in] aTb is the vector @f$ A^Tb @f$
@@ -64,25 +68,48 @@ public:
 	*/
 	void solve(const MatrixX& aTa, const VectorX& aTb, VectorX& x, bool affine, bool warmStart=false) {
 		int n=int(aTa.cols());
-
 		if (!warmStart) x=VectorX::Constant(n, _Scalar(1)/n);
+		Workspace<_Scalar> ws;
+		solve(aTa, aTb, x, affine, ws);
+	}
 
-		Eigen::ArrayXi idx(n);
+	/** Solve the least squares problem with scratch buffers, no heap allocation is made once the buffers of @p ws are large enough
+		@param[in] aTa is the cross product matrix @f$ A^TA @f$
+		@param[in] aTb is the vector @f$ A^Tb @f$
+		@param[in, out] x is the by-reference output and it is also the init solution
+		@param[in] affine=true will impose affinity constraint
+		@param[in] ws is the workspace, slots 0.. #WS_END-1 are used
+	*/
+	void solve(const Eigen::Ref<const MatrixX>& aTa, const Eigen::Ref<const VectorX>& aTb, Eigen::Ref<VectorX> x, bool affine, Workspace<_Scalar>& ws) {
+		int n=int(aTa.cols());
+
+		typename Workspace<_Scalar>::MapI idx=ws.indices(WS_IDX, n);
 		int np=0;
 		for (int i=0; i<n; i++)
 			if (x(i)>0) idx[np++]=i; else idx[n-i+np-1]=i;
 
-		VectorX p;
+		typename Workspace<_Scalar>::MapV p=ws.vector(WS_P, n);
 
 		for (int rep=0; rep<n; rep++) {
-			solveP(aTa, aTb, x, idx, np, affine, p);
+			solveP(aTa, aTb, x, idx, np, affine, p, ws);
 
-			if ((indexing_vector(x, idx.head(np))+indexing_vector(p, idx.head(np))).minCoeff()>=0) {
+			bool feasible=true;
+			for (int i=0; i<np; i++)
+				if (!(x(idx[i])+p(idx[i])>=0)) feasible=false;
+
+			if (feasible) {
 				x+=p;
 				if (np==n) break;
-				Eigen::Index iMax;
-				(indexing_vector(aTb, idx.tail(n-np))-indexing_row(aTa, idx.tail(n-np))*x).maxCoeff(&iMax);
-				std::swap(idx[iMax+np], idx[np]);
+				int iMax=-1;
+				_Scalar gMax=0;
+				for (int i=np; i<n; i++) {
+					_Scalar g=aTb(idx[i])-aTa.row(idx[i]).dot(x);
+					if ((iMax==-1)||(g>gMax)) {
+						gMax=g;
+						iMax=i;
+					}
+				}
+				std::swap(idx[iMax], idx[np]);
 				np++;
 			} else {
 				_Scalar alpha;
@@ -116,23 +143,251 @@ private:
 		@param[in] np is the size of the active set
 		@param[in] zeroSum=true will impose zer-sum of gradient
 		@param[output] p is the by-reference negative gradient output
+		@param[in] ws is the workspace
 	*/
-	void solveP(const MatrixX& aTa, const VectorX& aTb, const VectorX& x, const Eigen::ArrayXi& idx, int np, bool zeroSum, VectorX& p) {
-		VectorX z;
-		p.setZero(aTb.size());
-		if (!zeroSum) {
-			z=	indexing_row_col(aTa, idx.head(np), idx.head(np)).colPivHouseholderQr().solve( //A
-				indexing_vector(aTb, idx.head(np))-indexing_row(aTa, idx.head(np))*x);         //b
-			for (int ip=0; ip<np; ip++) p(idx[ip])=z(ip);
-		} else if (np>1) {
-			z=q2[np-2]*(	                                                                                                       //Re-project
-				(q2[np-2].transpose()*indexing_row_col(aTa, idx.head(np), idx.head(np))*q2[np-2]).colPivHouseholderQr().solve( //A
-				q2[np-2].transpose()*(indexing_vector(aTb, idx.head(np))-indexing_row(aTa, idx.head(np))*x) ));                //b
-			for (int ip=0; ip<np; ip++) p(idx[ip])=z(ip);
+	void solveP(const Eigen::Ref<const MatrixX>& aTa, const Eigen::Ref<const VectorX>& aTb, const Eigen::Ref<VectorX>& x, const typename Workspace<_Scalar>::MapI& idx, int np, bool zeroSum,
+		typename Workspace<_Scalar>::MapV& p, Workspace<_Scalar>& ws) {
+		p.setZero();
+		if ((!zeroSum)||(np>1)) {
+			typename Workspace<_Scalar>::MapX a=ws.matrix(WS_A, np, np);
+			typename Workspace<_Scalar>::MapV r=ws.vector(WS_R, np);
+			for (int c=0; c<np; c++) {
+				for (int ip=0; ip<np; ip++) a(ip, c)=aTa(idx[ip], idx[c]);
+				r(c)=aTb(idx[c])-aTa.row(idx[c]).dot(x);
+			}
+			if (!zeroSum) {
+				solveSPD(a, r, ws);
+				for (int ip=0; ip<np; ip++) p(idx[ip])=r(ip);
+			} else {
+				const MatrixX& q=q2[np-2];                                          //Re-project
+				typename Workspace<_Scalar>::MapX qa=ws.matrix(WS_QA, np-1, np);
+				typename Workspace<_Scalar>::MapX b=ws.matrix(WS_B, np-1, np-1);
+				typename Workspace<_Scalar>::MapV rhs=ws.vector(WS_RHS, np-1);
+				typename Workspace<_Scalar>::MapV z=ws.vector(WS_Z, np);
+				qa.noalias()=q.transpose().lazyProduct(a);
+				b.noalias()=qa.lazyProduct(q);                                      //A
+				rhs.noalias()=q.transpose().lazyProduct(r);                          //b
+				solveSPD(b, rhs, ws);
+				z.noalias()=q.lazyProduct(rhs);
+				for (int ip=0; ip<np; ip++) p(idx[ip])=z(ip);
+			}
+		}
+	}
+
+	/** Solve a symmetric positive definite system in place by Cholesky factorization, or by QR if the matrix is not positive definite
+		@param[in] a is the matrix
+		@param[in, out] b is the right hand side, it is also the by-reference output solution
+		@param[in] ws is the workspace, the QR fallback allocates outside of it and is counted as one allocation in Workspace::nAllocs
+	*/
+	static void solveSPD(const typename Workspace<_Scalar>::MapX& a, typename Workspace<_Scalar>::MapV& b, Workspace<_Scalar>& ws) {
+		int n=int(a.rows());
+		typename Workspace<_Scalar>::MapX l=ws.matrix(WS_L, n, n);
+		l=a;
+		for (int j=0; j<n; j++) {
+			_Scalar d=l(j, j);
+			for (int k=0; k<j; k++) d-=l(j, k)*l(j, k);
+			if (!(d>Eigen::NumTraits<_Scalar>::epsilon()*std::abs(a(j, j)))) {
+				b=MatrixX(a).colPivHouseholderQr().solve(VectorX(b));
+				ws.nAllocs++;
+				return;
+			}
+			l(j, j)=std::sqrt(d);
+			for (int i=j+1; i<n; i++) {
+				_Scalar s=l(i, j);
+				for (int k=0; k<j; k++) s-=l(i, k)*l(j, k);
+				l(i, j)=s/l(j, j);
+			}
+		}
+		for (int i=0; i<n; i++) {
+			for (int k=0; k<i; k++) b(i)-=l(i, k)*b(k);
+			b(i)/=l(i, i);
+		}
+		for (int i=n-1; i>=0; i--) {
+			for (int k=i+1; k<n; k++) b(i)-=l(k, i)*b(k);
+			b(i)/=l(i, i);
 		}
 	}
 };
 
+
+/** @class ConvexLSFixed ConvexLS.h "DemBones/ConvexLS.h"
+	@brief Fixed-size variant of ConvexLS for small problems
+	@details Solve the same problem as ConvexLS with the same active set method for at most @b _MaxN unknowns.
+	All matrices are fixed-size and stack-allocated. The Cholesky factorization of the passive block of @f$ A^TA @f$ is updated
+	incrementally: a row is appended when a variable enters the passive set and Givens rotations restore the triangular form when a variable leaves it.
+	The affinity constraint is handled by the Lagrange multiplier of @f$ x(0) +.. + x(n-1) = 1 @f$, which gives the same step as the projection of ConvexLS.
+
+	@b _Scalar is the floating-point data type. @b _MaxN is the maximum size of the unknown @f$ x @f$.
+*/
+template<class _Scalar, int _MaxN>
+class ConvexLSFixed {
+public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	using MatrixX=Eigen::Matrix<_Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+	using VectorX=Eigen::Matrix<_Scalar, Eigen::Dynamic, 1>;
+	using MatrixN=Eigen::Matrix<_Scalar, _MaxN, _MaxN>;
+	using VectorN=Eigen::Matrix<_Scalar, _MaxN, 1>;
+
+	/** Solve the least squares problem, warm started by @p x
+		@param[in] aTa is the cross product matrix @f$ A^TA @f$, @p aTa.cols() <= @b _MaxN
+		@param[in] aTb is the vector @f$ A^Tb @f$
+		@param[in, out] x is the by-reference output and it is also the init solution
+		@param[in] affine=true will impose affinity constraint
+		@return false if a passive block of @p aTa is not positive definite, @p x is then unchanged and ConvexLS should be used
+	*/
+	bool solve(const Eigen::Ref<const MatrixX>& aTa, const Eigen::Ref<const VectorX>& aTb, Eigen::Ref<VectorX> x, bool affine) {
+		int n=int(aTa.cols());
+		if (n>_MaxN) return false;
+
+		VectorN x0;
+		x0.head(n)=x;
+		int idx[_MaxN];
+		int np=0;
+		for (int i=0; i<n; i++)
+			if (x(i)>0) idx[np++]=i; else idx[n-i+np-1]=i;
+
+		Chol chol;
+		for (int i=0; i<np; i++)
+			if (!chol.add(aTa, idx[i])) {
+				x=x0.head(n);
+				return false;
+			}
+
+		VectorN p;
+		for (int rep=0; rep<n; rep++) {
+			chol.solveP(aTa, aTb, x, affine, p);
+
+			bool feasible=true;
+			for (int i=0; i<np; i++)
+				if (!(x(idx[i])+p(idx[i])>=0)) feasible=false;
+
+			if (feasible) {
+				x+=p.head(n);
+				if (np==n) break;
+				int iMax=-1;
+				_Scalar gMax=0;
+				for (int i=np; i<n; i++) {
+					_Scalar g=aTb(idx[i])-aTa.row(idx[i]).dot(x);
+					if ((iMax==-1)||(g>gMax)) {
+						gMax=g;
+						iMax=i;
+					}
+				}
+				std::swap(idx[iMax], idx[np]);
+				if (!chol.add(aTa, idx[np])) {
+					x=x0.head(n);
+					return false;
+				}
+				np++;
+			} else {
+				_Scalar alpha;
+				int iMin=-1;
+				for (int i=0; i<np; i++)
+					if (p(idx[i])<0) {
+						if ((iMin==-1)||(x(idx[i])<-alpha*p(idx[i]))) {
+							alpha=-x(idx[i])/p(idx[i]);
+							iMin=i;
+						}
+					}
+				x+=alpha*p.head(n);
+				_Scalar eps=std::abs(x(idx[iMin]));
+				x(idx[iMin])=0;
+				for (int i=0; i<np; i++)
+					if (x(idx[i])<=eps) {
+						chol.remove(idx[i]);
+						std::swap(idx[i--], idx[--np]);
+					}
+			}
+			if (affine) x/=x.sum();
+		}
+		return true;
+	}
+
+private:
+	//! Cholesky factorization L*L^T of the passive block of aTa, in the order the variables entered
+	struct Chol {
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+		MatrixN l;
+		int var[_MaxN];
+		int nc;
+
+		Chol(): nc(0) {}
+
+		/** Append a variable
+			@return false if the extended block is not positive definite
+		*/
+		bool add(const Eigen::Ref<const MatrixX>& aTa, int v) {
+			for (int r=0; r<nc; r++) {
+				_Scalar s=aTa(var[r], v);
+				for (int c=0; c<r; c++) s-=l(r, c)*l(nc, c);
+				l(nc, r)=s/l(r, r);
+			}
+			_Scalar d=aTa(v, v);
+			for (int c=0; c<nc; c++) d-=l(nc, c)*l(nc, c);
+			if (!(d>Eigen::NumTraits<_Scalar>::epsilon()*std::abs(aTa(v, v)))) return false;
+			l(nc, nc)=std::sqrt(d);
+			var[nc++]=v;
+			return true;
+		}
+
+		/** Remove a variable, the rows below it are shifted up and re-triangularized by Givens rotations
+		*/
+		void remove(int v) {
+			int k=0;
+			while (var[k]!=v) k++;
+			for (int r=k; r<nc-1; r++) {
+				var[r]=var[r+1];
+				for (int c=0; c<=r+1; c++) l(r, c)=l(r+1, c);
+			}
+			nc--;
+			for (int j=k; j<nc; j++) {
+				_Scalar a=l(j, j), b=l(j, j+1);
+				_Scalar rr=std::sqrt(a*a+b*b);
+				_Scalar cs=a/rr, sn=b/rr;
+				for (int r=j; r<nc; r++) {
+					_Scalar t1=l(r, j), t2=l(r, j+1);
+					l(r, j)=cs*t1+sn*t2;
+					l(r, j+1)=-sn*t1+cs*t2;
+				}
+			}
+		}
+
+		//! Solve L*L^T*y=b in place
+		void solveInPlace(VectorN& b) const {
+			for (int i=0; i<nc; i++) {
+				for (int k=0; k<i; k++) b(i)-=l(i, k)*b(k);
+				b(i)/=l(i, i);
+			}
+			for (int i=nc-1; i>=0; i--) {
+				for (int k=i+1; k<nc; k++) b(i)-=l(k, i)*b(k);
+				b(i)/=l(i, i);
+			}
+		}
+
+		/** Solve the gradient on the passive variables
+			@param[in] zeroSum=true will impose zero-sum of gradient
+			@param[output] p is the by-reference negative gradient output
+		*/
+		void solveP(const Eigen::Ref<const MatrixX>& aTa, const Eigen::Ref<const VectorX>& aTb, const Eigen::Ref<VectorX>& x, bool zeroSum, VectorN& p) const {
+			int n=int(aTa.cols());
+			p.head(n).setZero();
+			if (zeroSum&&(nc<2)) return;
+			VectorN y1, y2;
+			for (int c=0; c<nc; c++) {
+				y1(c)=aTb(var[c])-aTa.row(var[c]).dot(x);
+				y2(c)=1;
+			}
+			solveInPlace(y1);
+			if (zeroSum) {
+				solveInPlace(y2);
+				_Scalar mu=y1.head(nc).sum()/y2.head(nc).sum();
+				y1.head(nc)-=mu*y2.head(nc);
+			}
+			for (int c=0; c<nc; c++) p(var[c])=y1(c);
+		}
+	};
+};
+
 }
 
 #endif
@@ -14,10 +14,27 @@
 #include <algorithm>
 #include <queue>
 #include <vector>
-#include <set>
 #include <stack>
 #include <iostream>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <fstream>
+#include <cstdio>
+#include <stdexcept>
 #include "ConvexLS.h"
+#include "RigidFit.h"
+#include "Workspace.h"
+#include "FrameTiles.h"
+#include "FrameSource.h"
+#include "SolverCache.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 #ifndef DEM_BONES_MAT_BLOCKS
@@ -38,16 +55,18 @@ namespace Dem
 	Include DemBones/DemBonesExt.h (or DemBones/DemBones.h) with optional DemBones/MatBlocks.h then follow these steps to use the library:
 	-# Load required data in the base class:
 		- Rest shapes: DemBones::u, DemBones::fv, DemBones::nV
-		- Sequence: DemBones::v, DemBones::nF, DemBones::fStart, DemBones::subjectID, DemBones::nS
+		- Sequence: DemBones::v (or DemBones::frameSource), DemBones::nF, DemBones::fStart, DemBones::subjectID, DemBones::nS
 		- Number of bones DemBones::nB
 	-# Load optional data in the base class:
 		- Skinning weights DemBones::w and weights soft-lock DemBones::lockW
 		- Bone transformations DemBones::m and bones hard-lock DemBones::lockM
 	-# [@c optional] Set parameters in the base class: 
-		- DemBones::nIters
-		- DemBones::nInitIters
+		- DemBones::nIters, DemBones::multiLevels, DemBones::levelIters, DemBones::repFrames
+		- DemBones::nInitIters, DemBones::initMethod, DemBones::labelBuckets
 		- DemBones::nTransIters, DemBones::transAffine, DemBones::transAffineNorm
-		- DemBones::nWeightsIters, DemBones::nnz, DemBones::weightsSmooth, DemBones::weightsSmoothStep, DemBones::weightEps
+		- DemBones::streamChunkSize
+		- DemBones::nWeightsIters, DemBones::nnz, DemBones::nCandBones, DemBones::weightsSmooth, DemBones::weightsSmoothStep, DemBones::weightsSmoothRings, DemBones::weightEps
+		- DemBones::smoothCacheDir
 	-# [@c optional] Setup extended class:
 		- Load data: DemBonesExt::parent, DemBonesExt::preMulInv, DemBonesExt::rotOrder, DemBonesExt::orient, DemBonesExt::bind
 		- Set parameter DemBonesExt::bindUpdate
@@ -80,12 +99,28 @@ public:
 	using Vector3=Eigen::Matrix<_Scalar, 3, 1>;
 	using SparseMatrix=Eigen::SparseMatrix<_Scalar>;
 	using Triplet=Eigen::Triplet<_Scalar>;
+	//! Accumulator type of the sums prone to cancellation (#vuT, #uuT, #laplacian, rmse()), double precision whatever @b _Scalar is
+	using AccScalar=double;
+	using MatrixXA=Eigen::Matrix<AccScalar, Eigen::Dynamic, Eigen::Dynamic>;
+	using VectorXA=Eigen::Matrix<AccScalar, Eigen::Dynamic, 1>;
+	using SparseMatrixA=Eigen::SparseMatrix<AccScalar>;
+	using SparseVectorA=Eigen::SparseVector<AccScalar>;
 
 	//! [@c parameter] Number of global iterations, @c default = 30
 	int nIters;
+	//! [@c parameter] Number of coarse levels of compute(), each one with about 4 times fewer vertices than the next finer one, see computeCoarseLevels(), 0 = single level, @c default = 0
+	int multiLevels;
+	//! [@c parameter] Number of global iterations per coarse level of compute(), @c default = 3
+	int levelIters;
+	//! [@c parameter] Number of representative frames on which compute() solves the weights, see computeRepFrames(), 0 = all frames, @c default = 0
+	int repFrames;
 
 	//! [@c parameter] Number of clustering update iterations in the initalization, @c default = 10
 	int nInitIters;
+	//! [@c parameter] Bones initialization of init(), 0 = LBG-VQ splitting of the clusters, 1 = k-means++ seeding of all the bones from the vertex motions, see seedKMeansPP(), @c default = 0
+	int initMethod;
+	//! [@c parameter] Number of error buckets of the parallel region growing in computeLabel(), 0 = serial region growing, @c default = 0
+	int labelBuckets;
 
 	//! [@c parameter] Number of bone transformations update iterations per global iteration, @c default = 5
 	int nTransIters;
@@ -93,24 +128,34 @@ public:
 	_Scalar transAffine;
 	//! [@c parameter] p-norm for bone translations affinity soft constraint, @c default = 4.0
 	_Scalar transAffineNorm;
+	//! [@c parameter] Number of frames per tile of #vTiles and per sparse-dense product block in compute_vuT(), 0 = accumulate per-vertex outer products in compute_vuT() and use 16 frames per tile, @c default = 16
+	int vuTBlockSize;
+	//! [@c parameter] Number of frames per chunk read from #frameSource, two chunks of 3*#streamChunkSize*#nV values (and their tiles) are held in memory, @c default = 128
+	int streamChunkSize;
 	
 	//! [@c parameter] Number of weights update iterations per global iteration, @c default = 3
 	int nWeightsIters;
 	//! [@c parameter] Number of non-zero weights per vertex, @c default = 8
 	int nnz;
+	//! [@c parameter] Number of candidate bones per vertex in the weights update, taken from the current weights then the nearest rest pose bone centroids, 0 = all bones, @c default = 32
+	int nCandBones;
 	//! [@c parameter] Weights smoothness soft constraint, @c default = 1e-4
 	_Scalar weightsSmooth;	
 	//! [@c parameter] Step size for the weights smoothness soft constraint, @c default = 1.0
 	_Scalar weightsSmoothStep;
+	//! [@c parameter] Number of rings of the mesh around the support of a bone on which its weights are smoothed, bones with unchanged weights reuse their previous smoothing, 0 = smooth on the whole mesh, @c default = 0
+	int weightsSmoothRings;
 	//! [@c parameter] Epsilon for weights solver, @c default = 1e-15
 	_Scalar weightEps;
+	//! [@c parameter] Directory of the on-disk cache of computeSmoothSolver(), see smoothCacheKey(), empty = no cache, @c default = ""
+	std::string smoothCacheDir;
 	
 	/** @brief Constructor and setting default parameters
 	*/
-	DemBones():	nIters(30), nInitIters(10),
-			nTransIters(5),	transAffine(_Scalar(10)), transAffineNorm(_Scalar(4)),
-			nWeightsIters(3), nnz(8), weightsSmooth(_Scalar(1e-4)), weightsSmoothStep(_Scalar(1)),
-			weightEps(_Scalar(1e-15)),
+	DemBones():	nIters(30), multiLevels(0), levelIters(3), repFrames(0), nInitIters(10), initMethod(0), labelBuckets(0),
+			nTransIters(5),	transAffine(_Scalar(10)), transAffineNorm(_Scalar(4)), vuTBlockSize(16), streamChunkSize(128),
+			nWeightsIters(3), nnz(8), nCandBones(32), weightsSmooth(_Scalar(1e-4)), weightsSmoothStep(_Scalar(1)), weightsSmoothRings(0),
+			weightEps(_Scalar(1e-15)), smoothCacheDir(""),
 			iter(_iter), iterTransformations(_iterTransformations), iterWeights(_iterWeights) {
 		clear();
 	}
@@ -129,6 +174,12 @@ public:
 	//! Subject index of the frame, @c size = #nF, #subjectID(@p k)=@p s, where #fStart(@p s) <= @p k < #fStart(<tt>s</tt>+1)
 	Eigen::VectorXi subjectID;
 
+	/** Weights of the frames in the fitting errors of the weights update and the initialization, @c size = #nF, or 0 for unit weights
+		@details A frame of weight @p c counts as @p c copies of the frame, e.g. the representative frames of computeRepFrames() are weighted by the sizes of their clusters.
+		The bone transformations of the frames are fitted independently so they do not depend on the weights.
+	*/
+	VectorX frameWeight;
+
 	//! Geometry at the rest poses, @c size = [3*#nS, #nV], #u.@a col(@p i).@a segment(3*@p s, 3) is the rest pose of vertex @p i of subject @p s
 	MatrixX u;
 
@@ -148,6 +199,12 @@ public:
 
 	//! Animated mesh sequence, @c size = [3*#nF, #nV], #v.@a col(@p i).@a segment(3*@p k, 3) is the position of vertex @p i at frame @p k
 	Eigen::Matrix<_AniMeshScalar, Eigen::Dynamic, Eigen::Dynamic> v;
+
+	/** Out-of-core mesh sequence, if set it replaces #v, which can be left empty
+		@details The kernels reading the sequence stream it by chunks of #streamChunkSize frames with FrameStream, the other data
+		are O(#nV*#nCandBones) or O(#nF*#nB). The sequence is assumed unchanged until clear().
+	*/
+	std::shared_ptr<FrameSource<_AniMeshScalar>> frameSource;
 	
 	//! Mesh topology, @c size=[<tt>number of polygons</tt>], #fv[@p p] is the vector of vertex indices of polygon @p p
 	std::vector<std::vector<int>> fv;
@@ -166,7 +223,8 @@ public:
 	Eigen::VectorXi keep_bones;	
 
 
-	MatrixX ErrVtxBoneAll;
+	//! Fitting errors to the candidate bones, ErrVtxBoneAll(@p c, @p i) is errorVtxBone(@p i, #boneCand(@p c, @p i))
+	MatrixXA ErrVtxBoneAll;
 
 
 	/** @brief Clear all data
@@ -175,15 +233,22 @@ public:
 		nV=nB=nS=nF=0;
 		fStart.resize(0);
 		subjectID.resize(0);
+		frameWeight.resize(0);
 		u.resize(0, 0);
 		w.resize(0, 0);
 		lockW.resize(0);
 		m.resize(0, 0);
 		lockM.resize(0);
 		v.resize(0, 0);
+		frameSource.reset();
+		vSqNorm.resize(0);
 		fv.resize(0);
 		modelSize=-1;
 		laplacian.resize(0, 0);
+		wsPrevT.resize(0, 0);
+		vTiles.clear();
+		weightsAllocs=0;
+		wmDirty=true;
 	}
 
 	/** @brief Initialize missing skinning weights and/or bone transformations
@@ -203,25 +268,45 @@ public:
 		if (((int)w.rows()!=nB)||((int)w.cols()!=nV)) { //No skinning weight
 			if (((int)m.rows()!=nF*4)||((int)m.cols()!=nB*4)) { //No transformation
 				int targetNB=nB;
-				//LBG-VQ
+				if (initMethod==1) {
+					//k-means++, then the bones removed by pruneBones() are re-seeded
+					int round=0;
+					bool cont=true;
+					while (cont) {
+						cbInitSplitBegin();
+						int prev=(round==0)?0:nB;
+						if (round==0) seedKMeansPP(targetNB);
+						else reseedBones(targetNB, round);
+						for (int rep=0; rep<nInitIters; rep++) {
+							computeTransFromLabel();
+							computeLabel();
+							pruneBones(3);
+						}
+						cont=(nB<targetNB)&&(nB>prev);
+						round++;
+						cbInitSplitEnd();
+					}
+				} else {
+					//LBG-VQ
 
-				connected_component(); // Initialize labels, where each component gets a different label
-				computeTransFromLabel();
-		
-				// std::cout << "Computed computeTransFromLabel from single label" << std::endl;
-
-				bool cont=true;
-				while (cont) {
-					cbInitSplitBegin();
-					int prev=nB;
-					split(targetNB, 3);
-					for (int rep=0; rep<nInitIters; rep++) {
-						computeTransFromLabel();
-						computeLabel();
-						pruneBones(3);
+					connected_component(); // Initialize labels, where each component gets a different label
+					computeTransFromLabel();
+			
+					// std::cout << "Computed computeTransFromLabel from single label" << std::endl;
+
+					bool cont=true;
+					while (cont) {
+						cbInitSplitBegin();
+						int prev=nB;
+						split(targetNB, 3);
+						for (int rep=0; rep<nInitIters; rep++) {
+							computeTransFromLabel();
+							computeLabel();
+							pruneBones(3);
+						}
+						cont=(nB<targetNB)&&(nB>prev);
+						cbInitSplitEnd();
 					}
-					cont=(nB<targetNB)&&(nB>prev);
-					cbInitSplitEnd();
 				}
 				lockM=Eigen::VectorXi::Zero(nB);
 				labelToWeights();
@@ -230,6 +315,7 @@ public:
 			if (((int)m.rows()!=nF*4)||((int)m.cols()!=nB*4)) { //No transformation
 				m=Matrix4::Identity().replicate(nF, nB);
 				lockM=Eigen::VectorXi::Zero(nB);
+				wmDirty=true;
 			}
 		}
 
@@ -258,20 +344,37 @@ public:
 		// init();
 		cbTranformationsBegin();
 
+		double t=wallTime();
 		compute_vuT();
+		cbTiming("vuT", wallTime()-t);
+		t=wallTime();
 		compute_uuT();
+		cbTiming("uuT", wallTime()-t);
 
+		//Bones are updated in order within each frame, frames are fitted in batches
+		const int nFBlk=16;
 		for (_iterTransformations=0; _iterTransformations<nTransIters; _iterTransformations++) {
 			cbTransformationsIterBegin();
-			#pragma omp parallel for
-			for (int k=0; k<nF; k++)
-				for (int j=0; j<nB; j++) 
-					if (lockM(j)==0) {
-						Matrix4 qpT=vuT.blk4(k, j);
-						for (int it=uuT.outerIdx(j); it<uuT.outerIdx(j+1); it++)
-							if (uuT.innerIdx(it)!=j) qpT-=m.blk4(k, uuT.innerIdx(it))*uuT.val.blk4(subjectID(k), it);
-						qpT2m(qpT, k, j);
-					}
+			#pragma omp parallel
+			{
+				RigidFit<_Scalar> fit;
+				#pragma omp for schedule(dynamic)
+				for (int k0=0; k0<nF; k0+=nFBlk) {
+					int nk=std::min(nFBlk, nF-k0);
+					fit.resize(nk);
+					for (int j=0; j<nB; j++) 
+						if (lockM(j)==0) {
+							for (int k=k0; k<k0+nk; k++) {
+								Matrix4 qpT=vuT.blk4(k, j);
+								for (int it=uuT.outerIdx(j); it<uuT.outerIdx(j+1); it++)
+									if (uuT.innerIdx(it)!=j) qpT-=m.blk4(k, uuT.innerIdx(it))*uuT.val.blk4(subjectID(k), it);
+								fit.set(k-k0, qpT);
+							}
+							fit.solve();
+							fitToM(fit, k0, j, 1, 0);
+						}
+				}
+			}
 			if (cbTransformationsIterEnd()) return;
 		}
 		
@@ -292,115 +395,100 @@ public:
 
 	*/
 	void compute_errorVtxBoneALL(){
-		ErrVtxBoneAll.resize(nV,nB);
-		ErrVtxBoneAll.setZero();
-		for (int i = 0; i < nV; ++i)
-			for (int j = 0; j < nB; ++j)
-				ErrVtxBoneAll(i,j) = errorVtxBone(i,j);
+		compute_boneCand();
+		compute_errorTerms();
+		ErrVtxBoneAll.resize(boneCand.rows(), nV);
+		if (frameSource) {
+			#pragma omp parallel for
+			for (int i=0; i<nV; i++)
+				for (int c=0; c<boneCand.rows(); c++) ErrVtxBoneAll(c, i)=errorVtxBoneQuad(i, boneCand(c, i));
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) {
+				typename FrameStream<_AniMeshScalar>::MapR vb=fs.frames();
+				#pragma omp parallel for
+				for (int i=0; i<nV; i++)
+					for (int c=0; c<boneCand.rows(); c++) ErrVtxBoneAll(c, i)+=errorVtxBoneCross(vb.col(i), fs.frameStart(), i, boneCand(c, i));
+			}
+			ErrVtxBoneAll=ErrVtxBoneAll.cwiseMax(AccScalar(0));
+			return;
+		}
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++)
+			for (int c=0; c<boneCand.rows(); c++) ErrVtxBoneAll(c, i)=errorVtxBoneFromTerms(i, boneCand(c, i));
 	}
 
 	void computeWeights() {
 		if (nWeightsIters==0) return;
 		
 		// init();
+		if (laplacian.cols()!=nV) computeSmoothSolver(); //Deferred by computeRepFrames()
 		cbWeightsBegin();
 		
 		compute_mTm();
+		compute_wCand();
+		compute_aTb();
+		compute_vSqNorm();
 
-
-		aTb=MatrixX::Zero(nB, nV);
 		wSolver.init(nnz);
-		std::vector<Triplet, Eigen::aligned_allocator<Triplet>> trip;
-		trip.reserve(nV*nnz);
+		Eigen::MatrixXi slotIdx(wCand.rows(), nV);
+		MatrixX slotVal(wCand.rows(), nV);
+		Eigen::VectorXi slotCount(nV);
+		if ((int)weightsWorkspace.size()<maxThreads()) weightsWorkspace.resize(maxThreads());
 
 		for (_iterWeights=0; _iterWeights<nWeightsIters; _iterWeights++) {
 			cbWeightsIterBegin();
 
 			compute_ws();
-			compute_aTb();
 
-			double reg_scale=pow(modelSize, 2)*nF;
+			double reg_scale=pow(modelSize, 2)*totalFrameWeight();
 
-			trip.clear();
+			long long prevAllocs=workspaceAllocs();
 			#pragma omp parallel for
 			for (int i=0; i<nV; i++) {
-				MatrixX aTai;
-				compute_aTa(i, aTai);
-				aTai=(1-lockW(i))*(aTai/reg_scale+weightsSmooth*MatrixX::Identity(nB, nB))+lockW(i)*MatrixX::Identity(nB, nB);
-				VectorX aTbi=(1-lockW(i))*(aTb.col(i)/reg_scale+weightsSmooth*ws.col(i))+lockW(i)*w.col(i);
-				VectorX x=(1-lockW(i))*ws.col(i)+lockW(i)*w.col(i);
-				VectorX ErrorBone = ErrVtxBoneAll.row(i);
-				// Eigen::ArrayXi idx=Eigen::ArrayXi::LinSpaced(nB, 0, nB-1); 
-
-				// For global update use selected bones
-				Eigen::ArrayXi idx=keep_bones;
-				// idx._set(keep_bones); 
-				// std::cout << "Idx" << idx << std::endl;
-				int modified_nB = int(keep_bones.size());
-
-				std::sort(idx.data(), idx.data()+modified_nB, [&ErrorBone](int i1, int i2) { return ErrorBone(i1)<ErrorBone(i2); });
-			
-
-				// int nnzi=std::min(nnz, nB);
-				// std::cout << "Idx" << idx << std::endl;
-
-				int nnzi=std::min(nnz, modified_nB);
-				// std::cout << "nnzi" << nnzi << std::endl;
-				// std::cout << "x[0]" << x(idx(nnzi-1)) << std::endl;
-				// std::cout << "x[1]" << x(idx(nnzi-2)) << std::endl;
-				// std::cout << "x[2]" << x(idx(nnzi-3)) << std::endl;
-
-				while ((x(idx(nnzi-1))<weightEps)&&nnzi>1){ 
-					nnzi--;
-					// std::cout << "nnzi" << nnzi << std::endl;
-				};
-				// std::cout << "weightEps" << weightEps << std::endl;
-
-
-				// if(i==343){
-				// 	std::cout << "Original:";
-				// 	for (int i = 0; i < modified_nB; ++i){
-				// 	 	std::cout << keep_bones(i) << " ";
-				// 	}
-				// 	std::cout << std::endl;
-				// 	std::cout << "Idx:";
-				// 	for (int i = 0; i < modified_nB; ++i){
-				// 	 	std::cout << idx(i) << " ";
-				// 	}
-				// 	std::cout << std::endl;
-
-				// 	std::cout << "Weights:";
-				// 	for (int i = 0; i < modified_nB; ++i){
-				// 	 	std::cout << x(idx(i)) << " ";
-				// 	}
-				// 	std::cout << std::endl;
-				// }
-
-
-				VectorX x0=w.col(i).toDense().cwiseMax(0.0);
-				x=indexing_vector(x0, idx.head(nnzi));
+				Workspace<_Scalar>& wk=weightsWorkspace[threadNum()];
+
+				// Candidate bones sorted by fitting error, drop the tail with vanishing smoothed weights
+				auto idx=wCand.col(i);
+				int nnzi=(int)idx.size();
+				while ((((1-lockW(i))*ws(nnzi-1, i)+lockW(i)*w.coeff(idx(nnzi-1), i))<weightEps)&&nnzi>1) nnzi--;
+
+				typename Workspace<_Scalar>::MapX aTai=wk.matrix(WS_ATA, nnzi, nnzi);
+				compute_aTa(i, idx.head(nnzi), aTai);
+				aTai=(1-lockW(i))*(aTai/reg_scale+weightsSmooth*MatrixX::Identity(nnzi, nnzi))+lockW(i)*MatrixX::Identity(nnzi, nnzi);
+				typename Workspace<_Scalar>::MapV aTbi=wk.vector(WS_ATB, nnzi);
+				typename Workspace<_Scalar>::MapV x=wk.vector(WS_X, nnzi);
+				for (int c=0; c<nnzi; c++) {
+					_Scalar wji=w.coeff(idx(c), i);
+					aTbi(c)=(1-lockW(i))*(aTb(c, i)/reg_scale+weightsSmooth*ws(c, i))+lockW(i)*wji;
+					x(c)=std::max(wji, _Scalar(0));
+				}
 				_Scalar s=x.sum();
-				if (s>_Scalar(0.1)) x/=s; else x=VectorX::Constant(nnzi, _Scalar(1)/nnzi);
+				if (s>_Scalar(0.1)) x/=s; else x.setConstant(_Scalar(1)/nnzi);
 
-				wSolver.solve(indexing_row_col(aTai, idx.head(nnzi), idx.head(nnzi)), indexing_vector(aTbi, idx.head(nnzi)), x, true, true);
+				// Small problems use the stack-allocated solvers, the dynamic one is the fallback
+				bool solved=false;
+				if (nnzi<=4) solved=wSolver4.solve(aTai, aTbi, x, true);
+				else if (nnzi<=8) solved=wSolver8.solve(aTai, aTbi, x, true);
+				if (!solved) wSolver.solve(aTai, aTbi, x, true, wk);
 
-				// Debug 0 case
-				// #pragma omp critical
-				// if(i%1000 == 0){
-				// 	for (int j=0; j<nnzi; j++)
-				// 		std::cout << "i " << i << " Bone:" << idx[j] << " Value:" << x(j) << std::endl;
-				// }
-
-				#pragma omp critical
+				// Non-zero weights go to the slots of vertex i, sorted by bone index
+				int n=0;
 				for (int j=0; j<nnzi; j++)
-					if (x(j)!=0) trip.push_back(Triplet(idx[j], i, x(j)));
-
-
-
+					if (x(j)!=0) {
+						int p=n++;
+						for (; (p>0)&&(slotIdx(p-1, i)>idx[j]); p--) {
+							slotIdx(p, i)=slotIdx(p-1, i);
+							slotVal(p, i)=slotVal(p-1, i);
+						}
+						slotIdx(p, i)=idx[j];
+						slotVal(p, i)=x(j);
+					}
+				slotCount(i)=n;
 			}
 
-			w.resize(nB, nV);
-			w.setFromTriplets(trip.begin(), trip.end());
+			weightsAllocs=workspaceAllocs()-prevAllocs;
+
+			slotsToWeights(slotIdx, slotVal, slotCount);
+			wmDirty=false;
 			
 			if (cbWeightsIterEnd()) return;
 		}
@@ -418,12 +506,17 @@ public:
 			- Skinning weights: #w
 			- Bone transformations: #m
 
-		Output: #w, #m. Missing #w and/or #m (with zero size) will be initialized by init().
+		Output: #w, #m. Missing #w and/or #m (with zero size) will be initialized by init(), or by computeCoarseLevels() if #multiLevels > 0.
+		The global iterations run on the coarse levels are counted in #nIters, at least one global iteration runs on the full mesh.
+		If 0 < #repFrames < #nF, all of this runs on representative frames, see computeRepFrames().
 	*/
 	void compute() {
+		if (computeRepFrames()) return;
+		int iterStart=computeCoarseLevels();
 		init();
 
-		for (_iter=0; _iter<nIters; _iter++) {
+		int iterEnd=(iterStart>0)?std::max(nIters, iterStart+1):nIters;
+		for (_iter=iterStart; _iter<iterEnd; _iter++) {
 			cbIterBegin();
 			computeTranformations();
 			compute_errorVtxBoneALL();
@@ -432,78 +525,480 @@ public:
 		}
 	}
 
-	//! @return Root mean squared reconstruction error
-	_Scalar rmse() {
-		_Scalar e=0;
-		#pragma omp parallel for
+	/** Copy the parameters of another solver
+		@param d is the solver to copy from
+	*/
+	void copyParameters(const DemBones& d) {
+		nIters=d.nIters;
+		multiLevels=d.multiLevels;
+		levelIters=d.levelIters;
+		repFrames=d.repFrames;
+		nInitIters=d.nInitIters;
+		initMethod=d.initMethod;
+		labelBuckets=d.labelBuckets;
+		nTransIters=d.nTransIters;
+		transAffine=d.transAffine;
+		transAffineNorm=d.transAffineNorm;
+		vuTBlockSize=d.vuTBlockSize;
+		streamChunkSize=d.streamChunkSize;
+		nWeightsIters=d.nWeightsIters;
+		nnz=d.nnz;
+		nCandBones=d.nCandBones;
+		weightsSmooth=d.weightsSmooth;
+		weightsSmoothStep=d.weightsSmoothStep;
+		weightsSmoothRings=d.weightsSmoothRings;
+		weightEps=d.weightEps;
+		smoothCacheDir=d.smoothCacheDir;
+	}
+
+	class ReducedSolver;
+
+	/** Initialize #w and #m by solving on coarser meshes, the first step of compute() if #multiLevels > 0
+		@details Nothing is done if #w or #m is given. The rest mesh is clustered by coarsenMesh(), the coarse mesh of the cluster representatives
+		is solved by compute() for #levelIters global iterations on each of the #multiLevels levels (recursively, the coarsest level runs init()),
+		then the result is prolonged: #m is kept as is since the bones and the frames are the same, and each vertex takes the weights of the representative
+		of its cluster. The coarse levels are solved by ReducedSolver.
+		@return number of global iterations run on the coarse levels, 0 if the mesh is not coarsened
+	*/
+	int computeCoarseLevels() {
+		if ((multiLevels<=0)||(levelIters<=0)) return 0;
+		if (((int)w.rows()==nB)&&((int)w.cols()==nV)) return 0;
+		if (((int)m.rows()==nF*4)&&((int)m.cols()==nB*4)) return 0;
+
+		Eigen::VectorXi cluster;
+		std::vector<int> rep;
+		std::vector<std::vector<int>> cfv;
+		coarsenMesh(cluster, rep, cfv);
+		int nC=int(rep.size());
+		if ((nC<=nB)||(nC*4>nV*3)) return 0; //Not enough coarse vertices for the bones, or too little coarsening to pay off
+
+		ReducedSolver level(*this);
+		level.multiLevels=multiLevels-1;
+		level.nIters=levelIters*multiLevels;
+		level.nV=nC;
+		level.nB=nB;
+		level.nS=nS;
+		level.nF=nF;
+		level.fStart=fStart;
+		level.subjectID=subjectID;
+		level.frameWeight=frameWeight;
+		level.u=u(Eigen::all, rep);
+		level.fv=cfv;
+		if (frameSource) {
+			level.v.resize(3*nF, nC);
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) level.v.middleRows(3*fs.frameStart(), 3*fs.frameCount())=fs.frames()(Eigen::all, rep);
+		} else level.v=v(Eigen::all, rep);
+
+		level.compute();
+
+		nB=level.nB;
+		m=level.m;
+		lockM=level.lockM;
+		std::vector<Triplet> trip;
+		trip.reserve(std::size_t(level.w.nonZeros())*nV/nC);
+		for (int i=0; i<nV; i++)
+			for (typename SparseMatrix::InnerIterator it(level.w, cluster(i)); it; ++it) trip.push_back(Triplet(int(it.row()), i, it.value()));
+		w.resize(nB, nV);
+		w.setFromTriplets(trip.begin(), trip.end());
+		wmDirty=true;
+		return level.nIters;
+	}
+
+	/** Cluster the vertices of the rest mesh into the vertices of a coarser mesh
+		@details The rest poses of the first subject are divided by a grid of cells of twice the mean edge length, a cluster is a set of vertices in the same cell
+		connected by edges inside the cell, so about 4 vertices of a surface mesh are merged while separated parts of the mesh are never merged.
+		@param cluster is the by-reference output, cluster(@p i) is the cluster of vertex @p i, [@c size] = #nV
+		@param rep is the by-reference output, rep[@p c] is the vertex of cluster @p c nearest to its centroid, the coarse vertex of the cluster
+		@param cfv is the by-reference output, the topology of the coarse mesh made of the edges between adjacent clusters
+	*/
+	void coarsenMesh(Eigen::VectorXi& cluster, std::vector<int>& rep, std::vector<std::vector<int>>& cfv) {
+		std::vector<std::pair<int, int>> edgeList;
+		meshEdges(fv, nV, edgeList);
+
+		AccScalar len=0;
+		for (const auto& e: edgeList) len+=(u.vec3(0, e.first)-u.vec3(0, e.second)).template cast<AccScalar>().norm();
+		AccScalar h=edgeList.empty()?0:2*len/edgeList.size();
+
+		Eigen::Matrix<AccScalar, 3, 1> lo=u.template topRows<3>().rowwise().minCoeff().template cast<AccScalar>();
+		Eigen::Matrix<std::int64_t, 3, Eigen::Dynamic> cell(3, nV);
+		for (int i=0; i<nV; i++)
+			cell.col(i)=(h>0)?((u.vec3(0, i).template cast<AccScalar>()-lo)/h).array().floor().template cast<std::int64_t>().matrix().eval():Eigen::Matrix<std::int64_t, 3, 1>(i, 0, 0);
+
+		//Union-find of the vertices connected inside the cells
+		std::vector<int> root(nV);
+		for (int i=0; i<nV; i++) root[i]=i;
+		auto find=[&](int i) {
+			while (root[i]!=i) i=root[i]=root[root[i]];
+			return i;
+		};
+		for (const auto& e: edgeList)
+			if (cell.col(e.first)==cell.col(e.second)) {
+				int a=find(e.first), b=find(e.second);
+				if (a!=b) root[std::max(a, b)]=std::min(a, b);
+			}
+
+		cluster.resize(nV);
+		int nC=0;
+		for (int i=0; i<nV; i++) cluster(i)=(find(i)==i)?nC++:cluster(find(i));
+
+		MatrixXA center=MatrixXA::Zero(3, nC);
+		Eigen::VectorXi count=Eigen::VectorXi::Zero(nC);
 		for (int i=0; i<nV; i++) {
-			_Scalar ei=0;
-			Matrix4 mki;
-			for (int k=0; k<nF; k++) {
-				mki.setZero();
-				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) mki+=it.value()*m.blk4(k, it.row());
-				ei+=(mki.template topLeftCorner<3, 3>()*u.vec3(subjectID(k), i)+mki.template topRightCorner<3, 1>()-v.vec3(k, i).template cast<_Scalar>()).squaredNorm();
+			center.col(cluster(i))+=u.vec3(0, i).template cast<AccScalar>();
+			count(cluster(i))++;
+		}
+		for (int c=0; c<nC; c++) center.col(c)/=count(c);
+		rep.assign(nC, -1);
+		VectorXA dist(nC);
+		for (int i=0; i<nV; i++) {
+			int c=cluster(i);
+			AccScalar d=(u.vec3(0, i).template cast<AccScalar>()-center.col(c)).squaredNorm();
+			if ((rep[c]<0)||(d<dist(c))) {
+				rep[c]=i;
+				dist(c)=d;
 			}
-			#pragma omp atomic
-			e+=ei;
 		}
-		return std::sqrt(e/nF/nV);
+
+		std::vector<std::pair<int, int>> cEdgeList;
+		for (const auto& e: edgeList) {
+			int a=cluster(e.first), b=cluster(e.second);
+			if (a!=b) cEdgeList.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+		}
+		std::sort(cEdgeList.begin(), cEdgeList.end());
+		cEdgeList.erase(std::unique(cEdgeList.begin(), cEdgeList.end()), cEdgeList.end());
+		cfv.resize(cEdgeList.size());
+		for (int e=0; e<(int)cEdgeList.size(); e++) cfv[e]={cEdgeList[e].first, cEdgeList[e].second};
+	}
+
+	/** Solve compute() on representative frames then recover the bone transformations of all the frames, the first step of compute() if 0 < #repFrames < #nF
+		@details The frames are clustered by selectRepFrames(). The representative frames, weighted by the sizes of their clusters (see #frameWeight),
+		are solved by compute() in a ReducedSolver, including init() and the coarse levels of #multiLevels, so the statistics of the weights update,
+		the Laplacian and the initialization are computed on these frames only. At the end of each global iteration, the results are taken by
+		fromRepFrames() and cbIterEnd() is called on all the frames, so the convergence checks see the error of the full problem. Then each frame
+		starts from the transformations of its representative and the transformations of all the frames are updated by one final computeTranformations().
+		@return true if the decomposition is done, false if the frames are not reduced
+	*/
+	bool computeRepFrames() {
+		if ((repFrames<=0)||(repFrames>=nF)) return false;
+
+		std::vector<int> rep;
+		Eigen::VectorXi frameRep;
+		selectRepFrames(rep, frameRep);
+		int nR=int(rep.size());
+		if (nR>=nF) return false;
+
+		ReducedSolver sub(*this, &frameRep);
+		sub.repFrames=0;
+		sub.nV=nV;
+		sub.nB=nB;
+		sub.nS=nS;
+		sub.nF=nR;
+		sub.fStart=Eigen::VectorXi::Zero(nS+1);
+		sub.subjectID.resize(nR);
+		for (int q=0; q<nR; q++) {
+			sub.subjectID(q)=subjectID(rep[q]);
+			sub.fStart(subjectID(rep[q])+1)++;
+		}
+		for (int s=0; s<nS; s++) sub.fStart(s+1)+=sub.fStart(s);
+		sub.frameWeight=VectorX::Zero(nR);
+		for (int k=0; k<nF; k++) sub.frameWeight(frameRep(k))+=frameWeightOf(k);
+		sub.u=u;
+		sub.fv=fv;
+		sub.w=w;
+		sub.lockW=lockW;
+		sub.lockM=lockM;
+		if (((int)m.rows()==nF*4)&&((int)m.cols()==nB*4)) {
+			sub.m.resize(4*nR, 4*nB);
+			for (int q=0; q<nR; q++) sub.m.middleRows(4*q, 4)=m.middleRows(4*rep[q], 4);
+		}
+		sub.v.resize(3*nR, nV);
+		if (frameSource) {
+			int q=0;
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); )
+				for (; (q<nR)&&(rep[q]<fs.frameStart()+fs.frameCount()); q++) sub.v.middleRows(3*q, 3)=fs.frames().middleRows(3*(rep[q]-fs.frameStart()), 3);
+		} else for (int q=0; q<nR; q++) sub.v.middleRows(3*q, 3)=v.middleRows(3*rep[q], 3);
+
+		sub.compute();
+		fromRepFrames(sub, frameRep);
+
+		computeTranformations();
+		return true;
 	}
 
+	/** Take the results of the solver of the representative frames of computeRepFrames(), each frame takes the transformations of its representative
+		@param sub is the solver of the representative frames
+		@param frameRep is the representative of each frame in @p sub, see selectRepFrames()
+	*/
+	void fromRepFrames(const DemBones& sub, const Eigen::VectorXi& frameRep) {
+		nB=sub.nB;
+		w=sub.w;
+		lockW=sub.lockW;
+		lockM=sub.lockM;
+		keep_bones=sub.keep_bones;
+		modelSize=sub.modelSize;
+		m.resize(4*nF, 4*nB);
+		for (int k=0; k<nF; k++) m.middleRows(4*k, 4)=sub.m.middleRows(4*frameRep(k), 4);
+		wmDirty=true;
+		_iter=sub.iter;
+	}
 
-	std::vector<_Scalar> vertex_rmse(std::vector<int> vert_inds) {
-		std::vector<_Scalar> vert_recon_err_list;
-		vert_recon_err_list.resize(vert_inds.size());
+	/** Cluster the frames in pose space into representative frames
+		@details The pose of a frame is the positions of up to 256 vertices spread over the vertex indices. Each subject gets a share of #repFrames
+		proportional to its number of frames, at least one, and its frames are clustered by k-means++ seeding and a few Lloyd iterations. The representative
+		of a cluster is its frame nearest to the centroid, then each frame is assigned to its nearest representative. The random draws are deterministic.
+		@param rep is the by-reference output, the representative frames in increasing order
+		@param frameRep is the by-reference output, rep[frameRep(@p k)] is the representative of frame @p k, [@c size] = #nF
+	*/
+	void selectRepFrames(std::vector<int>& rep, Eigen::VectorXi& frameRep) {
+		int nP=std::min(nV, 256);
+		Eigen::VectorXi sample(nP);
+		for (int p=0; p<nP; p++) sample(p)=int((2*(long long)p+1)*nV/(2*nP));
+		Eigen::MatrixXf x(3*nP, nF);
+		if (frameSource) {
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) poseChunk(fs.frames(), fs.frameStart(), sample, x);
+		} else poseChunk(v, 0, sample, x);
+
+		rep.clear();
+		frameRep.resize(nF);
+		for (int s=0; s<nS; s++) {
+			int k0=fStart(s), nFs=fStart(s+1)-fStart(s);
+			int nRs=std::min(std::max(int(std::lround(double(repFrames)*nFs/nF)), 1), nFs);
+
+			//k-means++ seeding
+			Eigen::MatrixXf center(3*nP, nRs);
+			center.col(0)=x.col(k0+std::min(int(uniform01(s)*nFs), nFs-1));
+			VectorXA d2(nFs);
+			#pragma omp parallel for
+			for (int kk=0; kk<nFs; kk++) d2(kk)=(x.col(k0+kk)-center.col(0)).squaredNorm();
+			int nc=1;
+			for (; nc<nRs; nc++) {
+				AccScalar sum=d2.sum();
+				if (sum<=0) break;
+				AccScalar r=uniform01((std::uint64_t(s)<<32)+nc)*sum;
+				int kk=0;
+				for (; (kk<nFs-1)&&(r>=d2(kk)); kk++) r-=d2(kk);
+				center.col(nc)=x.col(k0+kk);
+				#pragma omp parallel for
+				for (int kk2=0; kk2<nFs; kk2++) d2(kk2)=std::min(d2(kk2), AccScalar((x.col(k0+kk2)-center.col(nc)).squaredNorm()));
+			}
+			center.conservativeResize(3*nP, nc);
+
+			//Lloyd iterations
+			Eigen::VectorXi nearest(nFs);
+			for (int it=0; it<=5; it++) {
+				#pragma omp parallel for
+				for (int kk=0; kk<nFs; kk++) (center.colwise()-x.col(k0+kk)).colwise().squaredNorm().minCoeff(&nearest(kk));
+				if (it==5) break;
+				Eigen::MatrixXf sum=Eigen::MatrixXf::Zero(3*nP, nc);
+				Eigen::VectorXi count=Eigen::VectorXi::Zero(nc);
+				for (int kk=0; kk<nFs; kk++) {
+					sum.col(nearest(kk))+=x.col(k0+kk);
+					count(nearest(kk))++;
+				}
+				for (int c=0; c<nc; c++) if (count(c)>0) center.col(c)=sum.col(c)/float(count(c));
+			}
 
-		for (int ind=0; ind<vert_inds.size(); ind++) {
-			int i = vert_inds[ind];
-			_Scalar ei=0;
+			//Representatives nearest to the centroids
+			std::vector<int> repS(nc, -1);
+			std::vector<float> dist(nc);
+			for (int kk=0; kk<nFs; kk++) {
+				int c=nearest(kk);
+				float d=(x.col(k0+kk)-center.col(c)).squaredNorm();
+				if ((repS[c]<0)||(d<dist[c])) {
+					repS[c]=k0+kk;
+					dist[c]=d;
+				}
+			}
+			repS.erase(std::remove(repS.begin(), repS.end(), -1), repS.end());
+			std::sort(repS.begin(), repS.end());
+			int q0=int(rep.size());
+			rep.insert(rep.end(), repS.begin(), repS.end());
+
+			Eigen::MatrixXf repPose(3*nP, repS.size());
+			for (int q=0; q<(int)repS.size(); q++) repPose.col(q)=x.col(repS[q]);
 			#pragma omp parallel for
-			for (int k=0; k<nF; k++) {
-				Matrix4 mki;
-				mki.setZero();	
-				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) mki+=it.value()*m.blk4(k, it.row());
-				#pragma omp atomic
-				ei+=(mki.template topLeftCorner<3, 3>()*u.vec3(subjectID(k), i)+mki.template topRightCorner<3, 1>()-v.vec3(k, i).template cast<_Scalar>()).squaredNorm();
+			for (int kk=0; kk<nFs; kk++) {
+				int q;
+				(repPose.colwise()-x.col(k0+kk)).colwise().squaredNorm().minCoeff(&q);
+				frameRep(k0+kk)=q0+q;
 			}
-			vert_recon_err_list[ind] = std::sqrt(ei/nF);
 		}
-		return vert_recon_err_list;
 	}
 
-	std::vector<_Scalar> vertex_max_rmse(std::vector<int> vert_inds) {
-		std::vector<_Scalar> vert_recon_err_list;
-		vert_recon_err_list.resize(vert_inds.size());
+	/** Gather the poses of selectRepFrames() over a block of frames
+		@param vb is the block of frames, [@c size] = [3*@p nk, #nV]
+		@param k0 is the first frame of the block
+		@param sample is the sampled vertices
+		@param x is the by-reference output, x.@a col(@p k) is the pose of frame @p k
+	*/
+	template<class Derived>
+	void poseChunk(const Eigen::MatrixBase<Derived>& vb, int k0, const Eigen::VectorXi& sample, Eigen::MatrixXf& x) {
+		int nk=int(vb.rows())/3;
+		#pragma omp parallel for
+		for (int kk=0; kk<nk; kk++)
+			for (int p=0; p<int(sample.size()); p++) x.col(k0+kk).template segment<3>(3*p)=vb.vec3(kk, sample(p)).template cast<float>();
+	}
+
+	//! @return weight of frame @p k, see #frameWeight
+	_Scalar frameWeightOf(int k) const {
+		return (frameWeight.size()==nF)?frameWeight(k):_Scalar(1);
+	}
+
+	//! @return sum of the weights of the frames, #nF for unit weights
+	AccScalar totalFrameWeight() const {
+		return (frameWeight.size()==nF)?frameWeight.template cast<AccScalar>().sum():AccScalar(nF);
+	}
 
+	/** @return Root mean squared reconstruction error
+		@param exact=true will reconstruct every vertex, otherwise the error is evaluated by rmseFromTerms() if #m and #w are unchanged since the last weights update.
+		The expanded form of rmseFromTerms() cancels in single precision, so the reconstruction is always used when @b _Scalar is not double precision.
+	*/
+	_Scalar rmse(bool exact=false) {
+		if ((!exact)&&(!wmDirty)&&(std::numeric_limits<_Scalar>::digits>=std::numeric_limits<AccScalar>::digits)) return rmseFromTerms();
+
+		AccScalar e=0;
+		if (frameSource) {
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) e+=sumErrorChunk(fs.frames(), fs.frameStart());
+		} else e=sumErrorChunk(v, 0);
+		return _Scalar(std::sqrt(e/totalFrameWeight()/nV));
+	}
+
+	/** Sum of the squared reconstruction errors of all vertices over a block of frames
+		@param vb is the block of frames, [@c size] = [3*@p nk, #nV]
+		@param k0 is the first frame of the block
+	*/
+	template<class Derived>
+	AccScalar sumErrorChunk(const Eigen::MatrixBase<Derived>& vb, int k0) {
+		AccScalar e=0;
 		#pragma omp parallel for
-		for (int ind=0; ind<vert_inds.size(); ind++) {
-			int i = vert_inds[ind];
-			_Scalar ei=0;
-			for (int k=0; k<nF; k++) {
-				Matrix4 mki;
-				mki.setZero();	
-				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) mki+=it.value()*m.blk4(k, it.row());
-				_Scalar eif=(mki.template topLeftCorner<3, 3>()*u.vec3(subjectID(k), i)+mki.template topRightCorner<3, 1>()-v.vec3(k, i).template cast<_Scalar>()).squaredNorm();			
+		for (int i=0; i<nV; i++) {
+			AccScalar ei=vertexErrorChunk(vb.col(i), k0, i);
+			#pragma omp atomic
+			e+=ei;
+		}
+		return e;
+	}
 
-				ei= eif > ei ? eif:ei;
+	/** Squared reconstruction errors of one vertex over a block of frames
+		@param vi is the trajectory of vertex @p i over the block, [@c size] = 3*@p nk
+		@param k0 is the first frame of the block
+		@param i is the vertex index
+		@param eMax is the optional by-reference output, the maximum error over the block is merged into *@p eMax
+		@return the sum of the errors over the block
+	*/
+	template<class Derived>
+	AccScalar vertexErrorChunk(const Eigen::MatrixBase<Derived>& vi, int k0, int i, _Scalar* eMax=nullptr) {
+		AccScalar ei=0;
+		Matrix4 mki;
+		for (int kk=0; kk<int(vi.size())/3; kk++) {
+			int k=k0+kk;
+			mki.setZero();
+			for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) mki+=it.value()*m.blk4(k, it.row());
+			_Scalar eik=(mki.template topLeftCorner<3, 3>()*u.vec3(subjectID(k), i)+mki.template topRightCorner<3, 1>()-vi.template segment<3>(kk*3).template cast<_Scalar>()).squaredNorm();
+			ei+=frameWeightOf(k)*eik;
+			if (eMax) *eMax=std::max(*eMax, eik);
+		}
+		return ei;
+	}
+
+	/** Squared reconstruction errors of some vertices
+		@param vert_inds is the list of vertex indices
+		@param eSum is the by-reference output, eSum[@p ind] is the sum of the errors of vertex vert_inds[@p ind] over all frames
+		@param eMax is the by-reference output, eMax[@p ind] is the maximum error of vertex vert_inds[@p ind] over all frames
+	*/
+	void vertexErrors(const std::vector<int>& vert_inds, std::vector<AccScalar>& eSum, std::vector<_Scalar>& eMax) {
+		eSum.assign(vert_inds.size(), 0);
+		eMax.assign(vert_inds.size(), 0);
+		if (frameSource) {
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) vertexErrorsChunk(fs.frames(), fs.frameStart(), vert_inds, eSum, eMax);
+		} else vertexErrorsChunk(v, 0, vert_inds, eSum, eMax);
+	}
+
+	//! Accumulate vertexErrors() over a block of frames @p vb starting at frame @p k0
+	template<class Derived>
+	void vertexErrorsChunk(const Eigen::MatrixBase<Derived>& vb, int k0, const std::vector<int>& vert_inds, std::vector<AccScalar>& eSum, std::vector<_Scalar>& eMax) {
+		#pragma omp parallel for
+		for (int ind=0; ind<int(vert_inds.size()); ind++) eSum[ind]+=vertexErrorChunk(vb.col(vert_inds[ind]), k0, vert_inds[ind], &eMax[ind]);
+	}
+
+	/** Root mean squared reconstruction error from the terms of the last weights update
+		@details The error of vertex @p i is @f$ w_i^T A^TA w_i - 2 w_i^T A^Tb + \sum_k \|v_{ki}\|^2 @f$ where @f$ A^TA @f$ is built from #mTmP by compute_aTa(),
+		@f$ A^Tb @f$ is #aTb on the candidate bones #wCand and the last term is #vSqNorm. The cost is O(#nnz^2) per vertex instead of O(#nF*#nnz).
+	*/
+	_Scalar rmseFromTerms() {
+		AccScalar e=0;
+		#pragma omp parallel
+		{
+			Eigen::VectorXi idx;
+			VectorX x, b;
+			MatrixX aTa;
+			AccScalar et=0;
+			#pragma omp for
+			for (int i=0; i<nV; i++) {
+				int n=int(w.col(i).nonZeros());
+				idx.resize(n);
+				x.resize(n);
+				b.resize(n);
+				int c=0;
+				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it, c++) {
+					idx(c)=int(it.row());
+					x(c)=it.value();
+					int p=0;
+					while (wCand(p, i)!=idx(c)) p++;
+					b(c)=aTb(p, i);
+				}
+				aTa.resize(n, n);
+				compute_aTa(i, idx, aTa);
+				et+=x.dot(aTa*x)-2*x.dot(b)+vSqNorm(i);
 			}
-			#pragma omp critical
-			vert_recon_err_list[ind] = ei;
+			#pragma omp atomic
+			e+=et;
 		}
-		return vert_recon_err_list;
+		return _Scalar(std::sqrt(std::max(e, AccScalar(0))/totalFrameWeight()/nV));
 	}
 
+	/** True if #m or #w may have changed since the last weights update, so rmse() reconstructs the vertices instead of using rmseFromTerms()
+		@details It is set by the functions writing #m or #w and cleared by computeWeights(), code writing #m or #w directly must set it.
+	*/
+	bool wmDirty;
 
-	MatrixX compute_reconstruction(std::vector<int> vert_inds){
-		MatrixX reconstructed_pose;
-		reconstructed_pose.resize(3*nF, int(vert_inds.size()));
+	std::vector<_Scalar> vertex_rmse(std::vector<int> vert_inds) {
+		std::vector<AccScalar> eSum;
+		std::vector<_Scalar> eMax;
+		vertexErrors(vert_inds, eSum, eMax);
+
+		std::vector<_Scalar> vert_recon_err_list;
+		vert_recon_err_list.resize(vert_inds.size());
+		for (int ind=0; ind<vert_inds.size(); ind++)
+			vert_recon_err_list[ind] = _Scalar(std::sqrt(eSum[ind]/totalFrameWeight()));
+		return vert_recon_err_list;
+	}
+
+	std::vector<_Scalar> vertex_max_rmse(std::vector<int> vert_inds) {
+		std::vector<AccScalar> eSum;
+		std::vector<_Scalar> eMax;
+		vertexErrors(vert_inds, eSum, eMax);
+		return eMax;
+	}
 
-		// Set value zero 
-		reconstructed_pose.setZero();
 
-		if(vert_inds.size() == 0)
-			return reconstructed_pose;
+	MatrixX compute_reconstruction(std::vector<int> vert_inds){
+		MatrixX reconstructed_pose(3*nF, int(vert_inds.size()));
+		compute_reconstruction(vert_inds, reconstructed_pose);
+		return reconstructed_pose;
+	}
 
+	/** Reconstructed trajectories of some vertices
+		@param vert_inds is the list of vertex indices
+		@param out is the by-reference output, [@c size] = [3*#nF, @p vert_inds.@a size()], out.@a col(@p ind) is the trajectory of vertex @p vert_inds[@p ind]
+		@details Throw std::invalid_argument if @p out does not have this size or if a vertex index is out of range.
+	*/
+	void compute_reconstruction(const std::vector<int>& vert_inds, Eigen::Ref<MatrixX> out){
+		if ((out.rows()!=3*nF)||(out.cols()!=Eigen::Index(vert_inds.size())))
+			throw std::invalid_argument("compute_reconstruction: out must be of size ("+std::to_string(3*nF)+", "+std::to_string(vert_inds.size())+
+				"), got ("+std::to_string(out.rows())+", "+std::to_string(out.cols())+")");
+		for (int i: vert_inds)
+			if ((i<0)||(i>=nV)) throw std::invalid_argument("compute_reconstruction: vertex index "+std::to_string(i)+" out of range");
 		#pragma omp parallel for
 		for (int ind = 0; ind < int(vert_inds.size()); ++ind){
 			int i = vert_inds[ind];
@@ -511,13 +1006,9 @@ public:
 			for(int k=0;k<nF;k++){
 				mki.setZero();
 				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) mki+=it.value()*m.blk4(k, it.row());
-
-				#pragma omp critical
-				reconstructed_pose.vec3(k,ind) = mki.template topLeftCorner<3, 3>()*u.vec3(subjectID(k), i)+mki.template topRightCorner<3, 1>();
+				out.vec3(k,ind) = mki.template topLeftCorner<3, 3>()*u.vec3(subjectID(k), i)+mki.template topRightCorner<3, 1>();
 			}
 		}
-
-		return reconstructed_pose;		 
 	}
 
 	//! Callback function invoked before each spliting of bone clusters in initialization
@@ -550,6 +1041,9 @@ public:
 	//! Callback function invoked after each local weights update iteration, stop iteration if return true
 	virtual bool cbWeightsIterEnd() { return false; }
 
+	//! Callback function reporting the wall-clock time (in seconds) spent in the solver phase @p name, e.g. "vuT" or "uuT"
+	virtual void cbTiming(const std::string& name, double seconds) {}
+
 
 	//! mTm.size = (4*nS*nB, 4*nB), where mTm.block<4, 4>(s*nB+i, j) = \sum_{k=fStart(s)}^{fStart(s+1)-1} m.block<3, 4>(k*4, i*4)^T*m.block<3, 4>(k*4, j*4)
 	MatrixX mTm;
@@ -562,12 +1056,18 @@ public:
 // private:
 	int _iter, _iterTransformations, _iterWeights;
 
-	/** Best rigid transformation from covariance matrix
+	//! @return Wall-clock time stamp in seconds, used with cbTiming()
+	static double wallTime() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/** Best rigid transformation from covariance matrix, see RigidFit for the batched version
 		@param _qpT is the 4*4 covariance matrix
 		@param k is the frame number
 		@param j is the bone index
 	*/
 	void qpT2m(const Matrix4& _qpT, int k, int j) {
+		wmDirty=true;
 		if (_qpT(3, 3)!=0) {
 			Matrix4 qpT=_qpT/_qpT(3, 3);
 			Eigen::JacobiSVD<Matrix3> svd(qpT.template topLeftCorner<3, 3>()-qpT.template topRightCorner<3, 1>()*qpT.template bottomLeftCorner<1, 3>(), Eigen::ComputeFullU|Eigen::ComputeFullV);
@@ -578,20 +1078,234 @@ public:
 		}
 	}
 
+	/** Copy solved rigid transformations to #m
+		@param fit is the solved batch, block @p b goes to #m.@a blk4(@p k0+@p b*@p dk, @p j0+@p b*@p dj)
+		@param k0 is the frame number of the first block
+		@param j0 is the bone index of the first block
+		@param dk is the frame step between blocks
+		@param dj is the bone step between blocks
+	*/
+	void fitToM(const RigidFit<_Scalar>& fit, int k0, int j0, int dk, int dj) {
+		wmDirty=true;
+		for (int b=0; b<fit.size(); b++)
+			if (fit.valid(b)) {
+				int k=k0+b*dk, j=j0+b*dj;
+				m.rotMat(k, j)=fit.rotation(b);
+				m.transVec(k, j)=fit.translation(b);
+			}
+	}
+
 	/** Fitting error
 		@param i is the vertex index
 		@param j is the bone index
+		@param par is true to loop over the frames in parallel
 	*/
 	_Scalar errorVtxBone(int i, int j, bool par=true) {
-		_Scalar e=0;
+		AccScalar e=0;
+		if (frameSource) {
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) e+=errorVtxBoneChunk(fs.frames().col(i), fs.frameStart(), i, j, par);
+		} else e=errorVtxBoneChunk(v.col(i), 0, i, j, par);
+		return _Scalar(e);
+	}
+
+	/** Fitting error of one vertex to one bone over a block of frames, see errorVtxBone()
+		@param vi is the trajectory of vertex @p i over the block, [@c size] = 3*@p nk
+		@param k0 is the first frame of the block
+		@param i is the vertex index
+		@param j is the bone index
+		@param par is true to loop over the frames in parallel
+	*/
+	template<class Derived>
+	AccScalar errorVtxBoneChunk(const Eigen::MatrixBase<Derived>& vi, int k0, int i, int j, bool par) {
+		AccScalar e=0;
 		#pragma omp parallel for if(par)
-		for (int k=0; k<nF; k++)
+		for (int kk=0; kk<int(vi.size())/3; kk++) {
+			int k=k0+kk;
+			AccScalar ek=frameWeightOf(k)*(m.rotMat(k, j)*u.vec3(subjectID(k), i)+m.transVec(k, j)-vi.template segment<3>(kk*3).template cast<_Scalar>()).squaredNorm();
 			#pragma omp atomic
-			e+=(m.rotMat(k, j)*u.vec3(subjectID(k), i)+m.transVec(k, j)-v.vec3(k, i).template cast<_Scalar>()).squaredNorm();
+			e+=ek;
+		}
 		return e;
 	}
 
+	/** @brief Terms of the fitting errors of all vertices to all bones, see errorVtxBoneBlock()
+		@details With @f$ \tilde{u} @f$ the homogeneous rest pose of subject @p s and @f$ M_k @f$ the top 3 rows of #m.@a blk4(@p k, @p j),
+		errorVtxBone(@p i, @p j) = @f$ \sum_s \tilde{u}^T (\sum_k M_k^T M_k) \tilde{u} - 2 \sum_k v_k^T M_k \tilde{u} + \sum_k \|v_k\|^2 @f$.
+		The first term is a product of packed quadratic forms, the second one is a product of #v with the transformations.
+		The terms are large and cancel when the mesh is far from the origin, so they are stored and summed in @b AccScalar.
+	*/
+	struct ErrorTerms {
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+		//! q.@a col(@p j).@a segment<10>(10*@p s) is the packed quadratic form of bone @p j in subject @p s, see packQuad()
+		MatrixXA q;
+		//! mTop.@a middleRows(3*@p k, 3) = #m.@a middleRows(4*@p k, 3) times the weight of frame @p k, see #frameWeight
+		MatrixXA mTop;
+	} errTerms;
 
+	//! Squared norms of the vertex trajectories, vSqNorm(@p i) = #v.@a col(@p i).@a squaredNorm() with the frames weighted by #frameWeight
+	VectorXA vSqNorm;
+
+	/** Pre-compute #vSqNorm, only once per #frameSource as the streamed sequence does not change
+	*/
+	void compute_vSqNorm() {
+		if (frameSource&&(vSqNorm.size()==nV)) return;
+		vSqNorm=VectorXA::Zero(nV);
+		if (frameSource) {
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) vSqNormChunk(fs.frames(), fs.frameStart());
+		} else vSqNormChunk(v, 0);
+	}
+
+	//! Accumulate #vSqNorm over a block of frames @p vb starting at frame @p k0
+	template<class Derived>
+	void vSqNormChunk(const Eigen::MatrixBase<Derived>& vb, int k0) {
+		int nk=int(vb.rows())/3;
+		if (frameWeight.size()!=nF) {
+			#pragma omp parallel for
+			for (int i=0; i<nV; i++) vSqNorm(i)+=vb.col(i).template cast<AccScalar>().squaredNorm();
+			return;
+		}
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++)
+			for (int kk=0; kk<nk; kk++) vSqNorm(i)+=frameWeightOf(k0+kk)*vb.vec3(kk, i).template cast<AccScalar>().squaredNorm();
+	}
+
+	/** Pre-compute the terms of the fitting errors from #m and #v
+	*/
+	void compute_errorTerms() {
+		errTerms.q.resize(nS*10, nB);
+		errTerms.mTop.resize(nF*3, nB*4);
+		#pragma omp parallel for
+		for (int j=0; j<nB; j++)
+			for (int s=0; s<nS; s++) {
+				Eigen::Matrix<AccScalar, 4, 4> a=Eigen::Matrix<AccScalar, 4, 4>::Zero();
+				for (int k=fStart(s); k<fStart(s+1); k++) {
+					Eigen::Matrix<AccScalar, 3, 4> mk=m.blk4(k, j).template topRows<3>().template cast<AccScalar>();
+					a+=frameWeightOf(k)*mk.transpose()*mk;
+					errTerms.mTop.block(k*3, j*4, 3, 4)=frameWeightOf(k)*mk;
+				}
+				errTerms.q.col(j).template segment<10>(s*10)=packQuad(a);
+			}
+
+		compute_vSqNorm();
+	}
+
+	/** Fitting errors of a block of vertices to all bones by matrix products, compute_errorTerms() must be called first
+		@param i0 is the first vertex index
+		@param e is the by-reference output, e(@p r, @p j) = errorVtxBone(@p i0+@p r, @p j) for @p r < @p e.@a rows()
+	*/
+	void errorVtxBoneBlock(int i0, Eigen::Ref<MatrixXA> e) {
+		int ni=int(e.rows());
+		errorVtxBoneQuadBlock(i0, e);
+		for (int s=0; s<nS; s++) errorVtxBoneCrossBlock(v.block(fStart(s)*3, i0, (fStart(s+1)-fStart(s))*3, ni), fStart(s), i0, e);
+		e=e.cwiseMax(AccScalar(0));
+	}
+
+	/** Terms of the fitting errors of a block of vertices to all bones that do not depend on the frames, see errorVtxBoneBlock()
+		@param i0 is the first vertex index
+		@param e is the by-reference output
+	*/
+	void errorVtxBoneQuadBlock(int i0, Eigen::Ref<MatrixXA> e) {
+		int ni=int(e.rows());
+		e.colwise()=vSqNorm.segment(i0, ni);
+		MatrixXA up(ni, 10);
+		for (int s=0; s<nS; s++) {
+			for (int r=0; r<ni; r++) up.row(r)=packOuter(u.vec3(s, i0+r).homogeneous().template cast<AccScalar>()).transpose();
+			e.noalias()+=up*errTerms.q.middleRows(s*10, 10);
+		}
+	}
+
+	/** Add the cross terms of the fitting errors of a block of vertices to all bones over a block of frames of one subject, see errorVtxBoneBlock()
+		@param vb is the block of frames of the vertices, [@c size] = [3*@p nk, @p e.@a rows()]
+		@param k0 is the first frame of the block
+		@param i0 is the first vertex index
+		@param e is the by-reference output
+	*/
+	template<class Derived>
+	void errorVtxBoneCrossBlock(const Eigen::MatrixBase<Derived>& vb, int k0, int i0, Eigen::Ref<MatrixXA> e) {
+		int ni=int(e.rows()), s=subjectID(k0);
+		MatrixXA p=vb.template cast<AccScalar>().transpose()*errTerms.mTop.middleRows(k0*3, vb.rows());
+		for (int j=0; j<nB; j++)
+			for (int r=0; r<ni; r++)
+				e(r, j)-=2*p.row(r).template segment<4>(j*4).dot(u.vec3(s, i0+r).homogeneous().template cast<AccScalar>());
+	}
+
+	/** Fitting error of one vertex to one bone, compute_errorTerms() must be called first
+		@param i is the vertex index
+		@param j is the bone index
+	*/
+	AccScalar errorVtxBoneFromTerms(int i, int j) {
+		AccScalar e=errorVtxBoneQuad(i, j);
+		for (int s=0; s<nS; s++) e+=errorVtxBoneCross(v.block(fStart(s)*3, i, (fStart(s+1)-fStart(s))*3, 1), fStart(s), i, j);
+		return std::max(e, AccScalar(0));
+	}
+
+	/** Terms of the fitting error of one vertex to one bone that do not depend on the frames, see errorVtxBoneFromTerms()
+		@param i is the vertex index
+		@param j is the bone index
+	*/
+	AccScalar errorVtxBoneQuad(int i, int j) {
+		AccScalar e=vSqNorm(i);
+		for (int s=0; s<nS; s++) e+=errTerms.q.col(j).template segment<10>(s*10).dot(packOuter(u.vec3(s, i).homogeneous().template cast<AccScalar>()));
+		return e;
+	}
+
+	/** Cross term of the fitting error of one vertex to one bone over a block of frames of one subject, see errorVtxBoneFromTerms()
+		@param vi is the trajectory of vertex @p i over the block, [@c size] = 3*@p nk
+		@param k0 is the first frame of the block
+		@param i is the vertex index
+		@param j is the bone index
+	*/
+	template<class Derived>
+	AccScalar errorVtxBoneCross(const Eigen::MatrixBase<Derived>& vi, int k0, int i, int j) {
+		Eigen::Matrix<AccScalar, 1, 4> p=vi.template cast<AccScalar>().transpose()*errTerms.mTop.block(k0*3, j*4, vi.size(), 4);
+		return -2*p.dot(u.vec3(subjectID(k0), i).homogeneous().template cast<AccScalar>().transpose());
+	}
+
+	/** Fitting errors of all vertices to all bones
+		@param e is the by-reference output, e(@p i, @p j) = errorVtxBone(@p i, @p j)
+	*/
+	void compute_errorVtxBone(MatrixXA& e) {
+		compute_errorTerms();
+		e.resize(nV, nB);
+		const int nVBlk=256;
+		if (frameSource) {
+			#pragma omp parallel for schedule(dynamic)
+			for (int i0=0; i0<nV; i0+=nVBlk) errorVtxBoneQuadBlock(i0, e.middleRows(i0, std::min(nVBlk, nV-i0)));
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) {
+				typename FrameStream<_AniMeshScalar>::MapR vb=fs.frames();
+				#pragma omp parallel for schedule(dynamic)
+				for (int i0=0; i0<nV; i0+=nVBlk) {
+					int ni=std::min(nVBlk, nV-i0);
+					errorVtxBoneCrossBlock(vb.middleCols(i0, ni), fs.frameStart(), i0, e.middleRows(i0, ni));
+				}
+			}
+			e=e.cwiseMax(AccScalar(0));
+			return;
+		}
+		#pragma omp parallel for schedule(dynamic)
+		for (int i0=0; i0<nV; i0+=nVBlk) errorVtxBoneBlock(i0, e.middleRows(i0, std::min(nVBlk, nV-i0)));
+	}
+
+	/** Fitting errors of all vertices to the bones of their labels, O(#nV*#nF) instead of O(#nV*#nB*#nF) for compute_errorVtxBone()
+		@param e is the by-reference output, e(@p i) = errorVtxBone(@p i, #label(@p i)), 0 for a vertex without label
+	*/
+	void compute_errorVtxLabel(VectorXA& e) {
+		compute_errorTerms();
+		e.resize(nV);
+		if (frameSource) {
+			#pragma omp parallel for
+			for (int i=0; i<nV; i++) e(i)=(label(i)!=-1)?errorVtxBoneQuad(i, label(i)):0;
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) {
+				typename FrameStream<_AniMeshScalar>::MapR vb=fs.frames();
+				#pragma omp parallel for
+				for (int i=0; i<nV; i++) if (label(i)!=-1) e(i)+=errorVtxBoneCross(vb.col(i), fs.frameStart(), i, label(i));
+			}
+			e=e.cwiseMax(AccScalar(0));
+			return;
+		}
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++) e(i)=(label(i)!=-1)?errorVtxBoneFromTerms(i, label(i)):0;
+	}
 
 	// If bones are not defined create them. 
 	//! Connected Compononent. Assign each component a different label in the beginning 
@@ -652,6 +1366,15 @@ public:
 	/** Update labels of vertices
 	*/
 	void computeLabel() {
+		MatrixXA err;
+		compute_errorVtxBone(err);
+		computeLabel(err);
+	}
+
+	/** Update labels of vertices from the fitting errors of the current transformations
+		@param err is the fitting errors, err(@p i, @p j) = errorVtxBone(@p i, @p j), see compute_errorVtxBone()
+	*/
+	void computeLabel(const MatrixXA& err) {
 		VectorX ei(nV);
 		Eigen::VectorXi seed=Eigen::VectorXi::Constant(nB, -1);
 		VectorX gMin(nB);
@@ -659,7 +1382,7 @@ public:
 		for (int i=0; i<nV; i++) {
 			int j=label(i);
 			if (j!=-1) {
-				ei(i)=errorVtxBone(i, j, false);
+				ei(i)=err(i, j);
 				if ((seed(j)==-1)||(ei(i)<gMin(j))) {
 					#pragma omp critical
 					if ((seed(j)==-1)||(ei(i)<gMin(j))) {
@@ -670,26 +1393,37 @@ public:
 			}
 		}
 
-		std::priority_queue<Triplet, std::vector<Triplet, Eigen::aligned_allocator<Triplet>>, TripletLess> heap;
-		for (int j=0; j<nB; j++) if (seed(j)!=-1) heap.push(Triplet(j, seed(j), ei(seed(j))));
-
 		if (laplacian.cols()!=nV) computeSmoothSolver();
 
-		std::vector<bool> dirty(nV, true);
-		while (!heap.empty()) {
-			Triplet top=heap.top();
-			heap.pop();
-			int i=(int)top.col();
-			int j=(int)top.row();
-			if (dirty[i]) {
-				label(i)=j;
-				ei(i)=top.value();
-				dirty[i]=false;
-				for (typename SparseMatrix::InnerIterator it(laplacian, i); it; ++it) {
-					int i2=(int)it.row();
-					if (dirty[i2]) {
-						double tmp=(label(i2)==j)?ei(i2):errorVtxBone(i2, j);
-						heap.push(Triplet(j, i2, tmp));
+		if (labelBuckets>0) growLabelBuckets(err, seed);
+		else {
+			std::priority_queue<Triplet, std::vector<Triplet, Eigen::aligned_allocator<Triplet>>, TripletLess> heap;
+			//Smallest value pushed for each vertex, a larger one would be popped after the vertex is labelled
+			VectorX best=VectorX::Constant(nV, std::numeric_limits<_Scalar>::max());
+			for (int j=0; j<nB; j++) if (seed(j)!=-1) {
+				heap.push(Triplet(j, seed(j), ei(seed(j))));
+				best(seed(j))=ei(seed(j));
+			}
+
+			std::vector<bool> dirty(nV, true);
+			while (!heap.empty()) {
+				Triplet top=heap.top();
+				heap.pop();
+				int i=(int)top.col();
+				int j=(int)top.row();
+				if (dirty[i]) {
+					label(i)=j;
+					ei(i)=top.value();
+					dirty[i]=false;
+					for (typename SparseMatrixA::InnerIterator it(laplacian, i); it; ++it) {
+						int i2=(int)it.row();
+						if (dirty[i2]) {
+							double tmp=(label(i2)==j)?ei(i2):err(i2, j);
+							if (tmp<best(i2)) {
+								best(i2)=tmp;
+								heap.push(Triplet(j, i2, tmp));
+							}
+						}
 					}
 				}
 			}
@@ -697,54 +1431,155 @@ public:
 
 		#pragma omp parallel for
 		for (int i=0; i<nV; i++) 
-			if (label(i)==-1) {
-				_Scalar gMin;
-				for (int j=0; j<nB; j++) {
-					_Scalar ej=errorVtxBone(i, j, false);
-					if ((label(i)==-1)||(gMin>ej)) {
-						gMin=ej;
-						label(i)=j;
+			if (label(i)==-1) err.row(i).minCoeff(&label(i));
+	}
+
+	/** Parallel region growing of computeLabel()
+		@details A vertex reached from a neighbor labelled @p j gets the level max(level of the neighbor, @p err(@p i, @p j)), which is the order
+		in which the heap of the serial region growing labels the vertices. The levels are split into #labelBuckets buckets processed in increasing
+		order. A bucket is flooded by synchronous rounds over the graph of #laplacian, in which the vertices labelled in the previous round claim their
+		unlabelled neighbors, a vertex takes the smallest (level, bone) claim. The labels only differ from the serial region growing where the latter
+		depends on the order of the vertices inside a bucket. Vertices that are not reached keep their labels.
+		@param[in] err is the fitting errors, err(@p i, @p j) = errorVtxBone(@p i, @p j)
+		@param[in] seed is the start vertex of the bones, -1 for bones without vertices
+	*/
+	void growLabelBuckets(const MatrixXA& err, const Eigen::VectorXi& seed) {
+		//Claim key: level bits (non-negative float) then bone, the smallest key wins
+		auto pack=[](float l, int j) {
+			std::uint32_t b;
+			std::memcpy(&b, &l, sizeof(b));
+			return (std::uint64_t(b)<<32)|std::uint32_t(j);
+		};
+		auto level=[](std::uint64_t key) {
+			std::uint32_t b=std::uint32_t(key>>32);
+			float l;
+			std::memcpy(&l, &b, sizeof(l));
+			return l;
+		};
+		//Bucket bounds at the quantiles of the smallest error of each vertex, a lower bound of its level
+		std::vector<float> minErr(nV);
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++) minErr[i]=float(err.row(i).minCoeff());
+		std::sort(minErr.begin(), minErr.end());
+		std::vector<float> bound(labelBuckets-1);
+		for (int b=1; b<labelBuckets; b++) bound[b-1]=minErr[std::size_t(b)*nV/labelBuckets];
+		auto bucketOf=[&](float l) { return int(std::upper_bound(bound.begin(), bound.end(), l)-bound.begin()); };
+
+		std::vector<std::atomic<std::uint64_t>> key(nV);
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++) key[i].store(~std::uint64_t(0), std::memory_order_relaxed);
+		//Atomic minimum, return true if @p k improves the claim on @p i
+		auto claim=[&](int i, std::uint64_t k) {
+			std::uint64_t old=key[i].load(std::memory_order_relaxed);
+			while (k<old) if (key[i].compare_exchange_weak(old, k, std::memory_order_relaxed)) return true;
+			return false;
+		};
+
+		std::vector<std::vector<int>> bucket(labelBuckets);
+		for (int j=0; j<nB; j++) if (seed(j)!=-1) {
+			float l=std::max(float(err(seed(j), j)), 0.0f);
+			if (claim(seed(j), pack(l, j))) bucket[bucketOf(l)].push_back(seed(j));
+		}
+
+		int nT=maxThreads();
+		std::vector<std::vector<int>> next(nT);
+		std::vector<std::vector<std::pair<int, int>>> later(nT);
+		std::vector<char> done(nV, 0);
+		std::vector<int> frontier;
+		for (int b=0; b<labelBuckets; b++) {
+			//Claims that are still the best in this bucket
+			auto settle=[&](int i) {
+				if (done[i]||(bucketOf(level(key[i].load(std::memory_order_relaxed)))!=b)) return;
+				done[i]=1;
+				label(i)=int(key[i].load(std::memory_order_relaxed)&0xffffffff);
+				frontier.push_back(i);
+			};
+			frontier.clear();
+			for (int i: bucket[b]) settle(i);
+			std::vector<int>().swap(bucket[b]);
+
+			while (!frontier.empty()) {
+				#pragma omp parallel for schedule(dynamic, 256)
+				for (int f=0; f<(int)frontier.size(); f++) {
+					int i=frontier[f];
+					int j=label(i);
+					float l=level(key[i].load(std::memory_order_relaxed));
+					int t=threadNum();
+					for (typename SparseMatrixA::InnerIterator it(laplacian, i); it; ++it) {
+						int i2=(int)it.row();
+						if (done[i2]) continue;
+						float l2=std::max(l, float(err(i2, j)));
+						if (claim(i2, pack(l2, j))) {
+							int b2=bucketOf(l2);
+							if (b2==b) next[t].push_back(i2); else later[t].push_back(std::make_pair(b2, i2));
+						}
 					}
 				}
+
+				frontier.clear();
+				for (int t=0; t<nT; t++) {
+					for (int i2: next[t]) settle(i2);
+					for (const auto& p: later[t]) bucket[p.first].push_back(p.second);
+					next[t].clear();
+					later[t].clear();
+				}
 			}
+		}
 	}
 
-	
 	_Scalar rmse_from_cluster(std::vector<int> vert_inds,bool par=true) {
 		
 		MatrixX cluster_transform=Matrix4::Identity().replicate(nF, 1);
 		_Scalar cluster_error = 0;
-		#pragma omp parallel for if(par)
-		for (int k=0; k<nF; k++) {
-			MatrixX qpT=MatrixX::Zero(4, 4);
-			for (int ind=0; ind<vert_inds.size(); ind++) {
-				int i = vert_inds[ind];
-				qpT.blk4(0, 0)+=Vector4(v.vec3(k, i).template cast<_Scalar>().homogeneous())*u.vec3(subjectID(k), i).homogeneous().transpose();
+		RigidFit<_Scalar> fit(nF);
+		forEachTiles([&](const FrameTiles<_AniMeshScalar>& tiles) {
+			int nBlk=tiles.nFrameBlocks();
+			#pragma omp parallel for if(par)
+			for (int b=0; b<nBlk; b++) {
+				int k0=tiles.frameStart(b);
+				int nk=tiles.frameCount(b);
+				MatrixX qpT=MatrixX::Zero(4*nk, 4);
+				for (int ind=0; ind<vert_inds.size(); ind++) {
+					int i = vert_inds[ind];
+					int c=tiles.vertexBlock(i);
+					int ii=i-tiles.vertexStart(c);
+					typename FrameTiles<_AniMeshScalar>::MapR t=tiles.tile(b, c);
+					Vector4 _u=u.vec3(subjectID(k0), i).homogeneous();
+					for (int kk=0; kk<nk; kk++) qpT.blk4(kk, 0)+=Vector4(t(kk*3, ii), t(kk*3+1, ii), t(kk*3+2, ii), 1)*_u.transpose();
+				}
+				for (int kk=0; kk<nk; kk++) fit.set(k0+kk, qpT.blk4(kk, 0));
 			}
+		});
+		fit.solve();
+
+		forEachTiles([&](const FrameTiles<_AniMeshScalar>& tiles) {
+			int nBlk=tiles.nFrameBlocks();
+			#pragma omp parallel for if(par)
+			for (int b=0; b<nBlk; b++) {
+				int k0=tiles.frameStart(b);
+				int nk=tiles.frameCount(b);
+				for (int k=k0; k<k0+nk; k++)
+					if (fit.valid(k)) {
+						cluster_transform.rotMat(k, 0)=fit.rotation(k);
+						cluster_transform.transVec(k, 0)=fit.translation(k);
+					}
 
-			if (qpT(3, 3)!=0) {
-				qpT=qpT/qpT(3, 3);
-				Eigen::JacobiSVD<Matrix3> svd(qpT.template topLeftCorner<3, 3>()-qpT.template topRightCorner<3, 1>()*qpT.template bottomLeftCorner<1, 3>(), Eigen::ComputeFullU|Eigen::ComputeFullV);
-				Matrix3 d=Matrix3::Identity();
-				d(2, 2)=(svd.matrixU()*svd.matrixV().transpose()).determinant();
-				cluster_transform.rotMat(k, 0)=svd.matrixU()*d*svd.matrixV().transpose();
-				cluster_transform.transVec(k, 0)=qpT.template topRightCorner<3, 1>()-cluster_transform.rotMat(k, 0)*qpT.template bottomLeftCorner<1, 3>().transpose();
-			}
-			
-			// std::cout << "Cluster Transform:" << qpT << std::endl;
-			// std::cout << "Cluster Translation:" << cluster_transform.transVec(k,0) << std::endl;
-			// std::cout << "Cluster Rotation:" << cluster_transform.rotMat(k,0) << std::endl;
-
-			for (int ind=0; ind<vert_inds.size(); ind++) {
-				int i = vert_inds[ind];
-				// if(par==false)
-				// 	std::cout << "V':" << cluster_transform.rotMat(k, 0)*u.vec3(subjectID(k), i) << cluster_transform.transVec(k, 0) << v.vec3(k, i).template cast<_Scalar>() << std::endl;
+				_Scalar e=0;
+				for (int ind=0; ind<vert_inds.size(); ind++) {
+					int i = vert_inds[ind];
+					int c=tiles.vertexBlock(i);
+					int ii=i-tiles.vertexStart(c);
+					typename FrameTiles<_AniMeshScalar>::MapR t=tiles.tile(b, c);
+					Vector3 _u=u.vec3(subjectID(k0), i);
+					for (int kk=0; kk<nk; kk++)
+						e+=frameWeightOf(k0+kk)*(cluster_transform.rotMat(k0+kk, 0)*_u+cluster_transform.transVec(k0+kk, 0)-Vector3(t(kk*3, ii), t(kk*3+1, ii), t(kk*3+2, ii))).squaredNorm();
+				}
 				#pragma omp atomic
-				cluster_error+=(cluster_transform.rotMat(k, 0)*u.vec3(subjectID(k), i)+cluster_transform.transVec(k, 0)-v.vec3(k, i).template cast<_Scalar>()).squaredNorm();
+				cluster_error+=e;
 			}
-		}
+		});
 
-		cluster_error /= nF;
+		cluster_error /= totalFrameWeight();
 
 		return cluster_error;
 	}
@@ -754,17 +1589,48 @@ public:
 
 
 	/** Update bone transformation from label
+		@details The vertices are bucketed by label, then the covariance of every (frame block, bone) pair is accumulated in parallel over the
+		clusters of the pairs, and the rigid fits of all (frame, bone) pairs are solved in parallel over frames.
 	*/
 	void computeTransFromLabel() {
-		// std::cout << "Computing Trans for labels. nB:" << nB  << std::endl;
-		m=Matrix4::Identity().replicate(nF, nB);
-		#pragma omp parallel for
-		for (int k=0; k<nF; k++) {
-			MatrixX qpT=MatrixX::Zero(4, 4*nB);
+		//Counting sort of the vertices by label, order[start(j)..start(j+1)-1] are the vertices of bone j in increasing order
+		Eigen::VectorXi start=Eigen::VectorXi::Zero(nB+1);
+		for (int i=0; i<nV; i++) if (label(i)!=-1) start(label(i)+1)++;
+		for (int j=0; j<nB; j++) start(j+1)+=start(j);
+		Eigen::VectorXi order(start(nB));
+		Eigen::VectorXi pos=start.head(nB);
+		for (int i=0; i<nV; i++) if (label(i)!=-1) order(pos(label(i))++)=i;
+
+		MatrixXA qpT=MatrixXA::Zero(4*nF, 4*nB); //Centered by RigidFit, it cancels when the mesh is far from the origin
+		forEachTiles([&](const FrameTiles<_AniMeshScalar>& tiles) {
+			int nBlk=tiles.nFrameBlocks();
+			#pragma omp parallel for schedule(dynamic)
+			for (int t=0; t<nBlk*nB; t++) {
+				int b=t/nB, j=t%nB;
+				int k0=tiles.frameStart(b);
+				int nk=tiles.frameCount(b);
+				for (int p=start(j); p<start(j+1); p++) {
+					int i=order(p);
+					int c=tiles.vertexBlock(i);
+					int ii=i-tiles.vertexStart(c);
+					typename FrameTiles<_AniMeshScalar>::MapR tile=tiles.tile(b, c);
+					Eigen::Matrix<AccScalar, 4, 1> _u=u.vec3(subjectID(k0), i).homogeneous().template cast<AccScalar>();
+					for (int kk=0; kk<nk; kk++) qpT.blk4(k0+kk, j)+=Eigen::Matrix<AccScalar, 4, 1>(tile(kk*3, ii), tile(kk*3+1, ii), tile(kk*3+2, ii), 1)*_u.transpose();
+				}
+			}
+		});
 
-			for (int i=0; i<nV; i++) 
-				if (label(i)!=-1) qpT.blk4(0, label(i))+=Vector4(v.vec3(k, i).template cast<_Scalar>().homogeneous())*u.vec3(subjectID(k), i).homogeneous().transpose();
-			for (int j=0; j<nB; j++) qpT2m(qpT.blk4(0, j), k, j);
+		m=Matrix4::Identity().replicate(nF, nB);
+		wmDirty=true;
+		#pragma omp parallel
+		{
+			RigidFit<_Scalar> fit(nB);
+			#pragma omp for
+			for (int k=0; k<nF; k++) {
+				for (int j=0; j<nB; j++) fit.set(j, qpT.blk4(k, j));
+				fit.solve();
+				fitToM(fit, k, 0, 0, 1);
+			}
 		}
 	}
 
@@ -776,6 +1642,142 @@ public:
 		w.resize(nB, nV);
 		w.setFromTriplets(trip.begin(), trip.end());
 		lockW=VectorX::Zero(nV);
+		wmDirty=true;
+	}
+
+	/** Set matrix w in compressed-column form from per-vertex slots
+		@param idx is the bone indices, idx(@p c, @p i) is the bone of slot @p c of vertex @p i, the used slots of each vertex are sorted by bone index
+		@param val is the weights, val(@p c, @p i) is the weight of slot @p c of vertex @p i
+		@param count is the number of used slots, count(@p i) is the number of non-zero weights of vertex @p i
+	*/
+	void slotsToWeights(const Eigen::MatrixXi& idx, const MatrixX& val, const Eigen::VectorXi& count) {
+		using StorageIndex=typename SparseMatrix::StorageIndex;
+		w.resize(nB, nV);
+		StorageIndex* outer=w.outerIndexPtr();
+		outer[0]=0;
+		for (int i=0; i<nV; i++) outer[i+1]=outer[i]+count(i);
+		w.resizeNonZeros(outer[nV]);
+		StorageIndex* inner=w.innerIndexPtr();
+		_Scalar* value=w.valuePtr();
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++)
+			for (int c=0; c<count(i); c++) {
+				inner[outer[i]+c]=idx(c, i);
+				value[outer[i]+c]=val(c, i);
+			}
+	}
+
+	/** Initialize the labels by k-means|| (parallel k-means++) seeding on the vertex motions, sets #nB and #label
+		@details The motion of a vertex is its displacements from its rest pose at up to 16 frames evenly spread over the sequence, so the vertices
+		are grouped by how they move rather than by where they are, the bones are made spatially coherent by computeLabel(). Candidate centers are oversampled in
+		5 parallel passes, each vertex being drawn with a probability proportional to its squared distance to the nearest candidate. The candidates
+		weighted by their numbers of nearest vertices are reduced to @p k centers by k-means++, then each vertex takes the center of its nearest
+		candidate. The random draws are deterministic.
+		@param k is the number of bones
+	*/
+	void seedKMeansPP(int k) {
+		//Motions
+		int nD=std::min(nF, 16);
+		Eigen::VectorXi frame(nD);
+		for (int d=0; d<nD; d++) frame(d)=int((2*(long long)d+1)*nF/(2*nD));
+		Eigen::MatrixXf x(3*nD, nV);
+		forEachTiles([&](const FrameTiles<_AniMeshScalar>& tiles) {
+			for (int b=0; b<tiles.nFrameBlocks(); b++)
+				for (int d=0; d<nD; d++) {
+					int kk=frame(d)-tiles.frameStart(b);
+					if ((kk<0)||(kk>=tiles.frameCount(b))) continue;
+					#pragma omp parallel for
+					for (int c=0; c<tiles.nVertexBlocks(); c++)
+						x.block(3*d, tiles.vertexStart(c), 3, tiles.vertexCount(c))=tiles.tile(b, c).middleRows(3*kk, 3).template cast<float>()
+							-u.block(3*subjectID(frame(d)), tiles.vertexStart(c), 3, tiles.vertexCount(c)).template cast<float>();
+				}
+		});
+
+		//Oversampling, nearest(i) is the index in cand of the nearest candidate of vertex i
+		std::vector<int> cand(1, std::min(int(uniform01(0)*nV), nV-1));
+		VectorXA d2(nV);
+		Eigen::VectorXi nearest=Eigen::VectorXi::Zero(nV);
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++) d2(i)=(x.col(i)-x.col(cand[0])).squaredNorm();
+
+		int nT=maxThreads();
+		std::vector<std::vector<int>> drawn(nT);
+		for (int r=0; r<5; r++) {
+			AccScalar phi=d2.sum();
+			if (phi==0) break;
+			AccScalar l=2*k/phi;
+			#pragma omp parallel for
+			for (int i=0; i<nV; i++)
+				if (uniform01(std::uint64_t(r+1)*nV+i)<l*d2(i)) drawn[threadNum()].push_back(i);
+			int c0=(int)cand.size();
+			for (int t=0; t<nT; t++) {
+				cand.insert(cand.end(), drawn[t].begin(), drawn[t].end());
+				drawn[t].clear();
+			}
+			std::sort(cand.begin()+c0, cand.end());
+			#pragma omp parallel for
+			for (int i=0; i<nV; i++)
+				for (int c=c0; c<(int)cand.size(); c++) {
+					AccScalar e=(x.col(i)-x.col(cand[c])).squaredNorm();
+					if (e<d2(i)) {
+						d2(i)=e;
+						nearest(i)=c;
+					}
+				}
+		}
+
+		//Weighted k-means++ on the candidates
+		int nC=(int)cand.size();
+		VectorXA weight=VectorXA::Zero(nC);
+		for (int i=0; i<nV; i++) weight(nearest(i))++;
+		Eigen::VectorXi center=Eigen::VectorXi::Zero(nC);
+		if (nC<=k) center=Eigen::VectorXi::LinSpaced(nC, 0, nC-1);
+		else {
+			VectorXA cd2=VectorXA::Constant(nC, std::numeric_limits<AccScalar>::max());
+			int c=0;
+			weight.maxCoeff(&c);
+			for (int j=0; j<k; j++) {
+				for (int c2=0; c2<nC; c2++) {
+					AccScalar e=(x.col(cand[c2])-x.col(cand[c])).squaredNorm();
+					if (e<cd2(c2)) {
+						cd2(c2)=e;
+						center(c2)=j;
+					}
+				}
+				VectorXA p=weight.cwiseProduct(cd2);
+				AccScalar sum=p.sum();
+				if (sum==0) break;
+				AccScalar r=uniform01(std::uint64_t(6)*nV+j)*sum;
+				for (c=0; c<nC-1; c++) if ((r-=p(c))<0) break;
+			}
+		}
+
+		nB=center.maxCoeff()+1;
+		label.resize(nV);
+		#pragma omp parallel for
+		for (int i=0; i<nV; i++) label(i)=center(nearest(i));
+	}
+
+	/** Add bones where the fitting errors are the largest until there are @p k bones, init() re-seeds the bones removed by pruneBones() this way if #initMethod = 1
+		@details The seeds are drawn like k-means++ on the fitting errors: a vertex is drawn with a probability proportional to its fitting error to its bone,
+		then the errors of the seed and its neighbors are cleared. The new bone takes the seed and its neighbors, like split(). The random draws are deterministic.
+		@param k is the number of bones
+		@param round selects the random draws
+	*/
+	void reseedBones(int k, int round) {
+		VectorXA e;
+		compute_errorVtxLabel(e);
+		AccScalar sum=e.sum();
+		for (; (nB<k)&&(sum>0); nB++) {
+			AccScalar r=uniform01(std::uint64_t(8+round)*nV+nB)*sum;
+			int i=0;
+			for (; i<nV-1; i++) if ((r-=e(i))<0) break;
+			for (typename SparseMatrixA::InnerIterator it(laplacian, i); it; ++it) {
+				label(it.row())=nB;
+				sum-=e(it.row());
+				e(it.row())=0;
+			}
+		}
 	}
 
 	/** Split bone clusters
@@ -798,11 +1800,13 @@ public:
 		VectorX minE=VectorX::Constant(nB, std::numeric_limits<_Scalar>::max());
 		VectorX ce=VectorX::Zero(nB);
 
+		VectorXA err;
+		compute_errorVtxLabel(err);
 		#pragma omp parallel for
 		for (int i=0; i<nV; i++) {
 			int j=label(i);
 			d(i)=(u.col(i)-cu.col(j)).norm();
-			e(i)=sqrt(errorVtxBone(i, j, false));
+			e(i)=_Scalar(sqrt(err(i)));
 			if (d(i)<minD(j)) {
 				#pragma omp critical
 				minD(j)=std::min(minD(j), d(i));
@@ -841,7 +1845,7 @@ public:
 			if ((countID<maxB)&&(s(j)>threshold*2)&&(ce(j)>avgErr/100)) {
 				int newLabel=countID++;
 				int i=seed(j);
-				for (typename SparseMatrix::InnerIterator it(laplacian, i); it; ++it) label(it.row())=newLabel;
+				for (typename SparseMatrixA::InnerIterator it(laplacian, i); it; ++it) label(it.row())=newLabel;
 			}
 		}
 		nB=countID;
@@ -875,6 +1879,7 @@ public:
 
 		nB=countID;
 		m.conservativeResize(nF*4, nB*4);
+		wmDirty=true;
 		computeLabel();
 	}
 
@@ -882,42 +1887,135 @@ public:
 	*/
 	void initWeights() {
 		label=Eigen::VectorXi::Constant(nV, -1);
+		MatrixXA err;
+		compute_errorVtxBone(err);
 		#pragma omp parallel for
-		for (int i=0; i<nV; i++) {
-			_Scalar gMin;
-			for (int j=0; j<nB; j++) {
-				_Scalar ej=errorVtxBone(i, j, false);
-				if ((label(i)==-1)||(gMin>ej)) {
-					gMin=ej;
-					label(i)=j;
-				}
-			}
-		}
-		computeLabel();
+		for (int i=0; i<nV; i++) err.row(i).minCoeff(&label(i));
+		computeLabel(err); //Same transformations, the errors are reused
 		labelToWeights();
 	}
 
 	//! vuT.blk4(k, j) = \sum_{i=0}^{nV-1}  w(j, i)*v.vec3(k, i).homogeneous()*u.vec3(subjectID(k), i).homogeneous()^T
 	MatrixX vuT;
 
+	//! Tiled copy of #v for the kernels looping over frames then vertices, see frameTiles()
+	FrameTiles<_AniMeshScalar> vTiles;
+
+	/** Tiled sequence, #vTiles is rebuilt if #v, #fStart or #vuTBlockSize have changed dimensions
+		@details Call vTiles.@a clear() after changing the values of #v without changing its dimensions.
+	*/
+	const FrameTiles<_AniMeshScalar>& frameTiles() {
+		if (!vTiles.matches(v, fStart, tileFrames())) vTiles.build(v, fStart, tileFrames());
+		return vTiles;
+	}
+
+	//! @return number of frames per tile
+	int tileFrames() const {
+		return (vuTBlockSize>0)?vuTBlockSize:16;
+	}
+
+	/** Call @p f on the tiles of the whole sequence: #vTiles, or the tiles of each chunk streamed from #frameSource
+		@param f is called as @p f(tiles) with a const FrameTiles<_AniMeshScalar>& whose frame indices are absolute
+	*/
+	template<class Func>
+	void forEachTiles(Func f) {
+		if (!frameSource) {
+			f(frameTiles());
+			return;
+		}
+		for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize, tileFrames()); fs.next(); ) f(fs.tiles());
+	}
+
 	/** Pre-compute vuT with bone translations affinity soft constraint
 	*/
 	void compute_vuT() {
-		vuT=MatrixX::Zero(nF*4, nB*4);
+		if ((vuTBlockSize>0)||frameSource) compute_vuT_spmm(); else compute_vuT_outer();
+	}
+
+	/** Pre-compute vuT by accumulating 4*4 outer products per frame, vertex and bone
+	*/
+	void compute_vuT_outer() {
+		vuT.resize(nF*4, nB*4);
 		#pragma omp parallel for
 		for (int k=0; k<nF; k++) {
-			MatrixX vuTp=MatrixX::Zero(4, nB*4);
+			MatrixXA vuTk=MatrixXA::Zero(4, nB*4);
+			MatrixXA vuTp=MatrixXA::Zero(4, nB*4);
 			for (int i=0; i<nV; i++)
 				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) {
-					Matrix4 tmp=Vector4(v.vec3(k, i).template cast<_Scalar>().homogeneous())*u.vec3(subjectID(k), i).homogeneous().transpose();
-					vuT.blk4(k, it.row())+=it.value()*tmp;
-					vuTp.blk4(0, it.row())+=pow(it.value(), transAffineNorm)*tmp;
+					Eigen::Matrix<AccScalar, 4, 4> tmp=Eigen::Matrix<AccScalar, 4, 1>(v.vec3(k, i).template cast<AccScalar>().homogeneous())*u.vec3(subjectID(k), i).template cast<AccScalar>().homogeneous().transpose();
+					vuTk.blk4(0, it.row())+=AccScalar(it.value())*tmp;
+					vuTp.blk4(0, it.row())+=AccScalar(pow(it.value(), transAffineNorm))*tmp;
 				}
 			for (int j=0; j<nB; j++)
 				if (vuTp(3, j*4+3)!=0)
-					vuT.blk4(k, j)+=(transAffine*vuT(k*4+3, j*4+3)/vuTp(3, j*4+3))*vuTp.blk4(0, j);
+					vuTk.blk4(0, j)+=(transAffine*vuTk(3, j*4+3)/vuTp(3, j*4+3))*vuTp.blk4(0, j);
+			vuT.middleRows(k*4, 4)=vuTk.template cast<_Scalar>();
 		}
 	}
+
+	/** Pre-compute vuT as one sparse-dense product per block of #vuTBlockSize frames
+		@details For subject @p s, let wu.@a row(@p i).@a segment<4>(4*@p j) = #w(@p j, @p i)*#u.@a vec3(@p s, @p i).@a homogeneous(), 
+			then #vuT.@a block(4*@p k, 0, 3, 4*#nB) = #v.@a middleRows(3*@p k, 3)*wu and the homogeneous row of #vuT is the column sum of wu.
+			The affinity term uses the same product with #w(@p j, @p i)^#transAffineNorm, which is evaluated once per update.
+	*/
+	void compute_vuT_spmm() {
+		using SparseMatrixR=Eigen::SparseMatrix<AccScalar, Eigen::RowMajor>;
+		using TripletA=Eigen::Triplet<AccScalar>;
+		std::vector<SparseMatrixR> wu(nS), wpu(nS);
+		MatrixXA wuSum(nS, nB*4), wpuSum(nS, nB*4);
+		for (int s=0; s<nS; s++) {
+			std::vector<TripletA, Eigen::aligned_allocator<TripletA>> trip, tripP;
+			trip.reserve(w.nonZeros()*4);
+			tripP.reserve(w.nonZeros()*4);
+			for (int i=0; i<nV; i++) {
+				Eigen::Matrix<AccScalar, 4, 1> _u=u.vec3(s, i).template cast<AccScalar>().homogeneous();
+				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) {
+					AccScalar wp=pow(AccScalar(it.value()), AccScalar(transAffineNorm));
+					for (int c=0; c<4; c++) {
+						trip.push_back(TripletA(i, it.row()*4+c, it.value()*_u(c)));
+						tripP.push_back(TripletA(i, it.row()*4+c, wp*_u(c)));
+					}
+				}
+			}
+			wu[s].resize(nV, nB*4);
+			wu[s].setFromTriplets(trip.begin(), trip.end());
+			wpu[s].resize(nV, nB*4);
+			wpu[s].setFromTriplets(tripP.begin(), tripP.end());
+			wuSum.row(s)=VectorXA::Ones(nV).transpose()*wu[s];
+			wpuSum.row(s)=VectorXA::Ones(nV).transpose()*wpu[s];
+		}
+
+		//Frame blocks of the tiles never cross subjects
+		vuT.resize(nF*4, nB*4);
+		forEachTiles([&](const FrameTiles<_AniMeshScalar>& tiles) {
+			int nBlk=tiles.nFrameBlocks();
+			#pragma omp parallel for schedule(dynamic)
+			for (int b=0; b<nBlk; b++) {
+				int k0=tiles.frameStart(b);
+				int s=subjectID(k0);
+				int nk=tiles.frameCount(b);
+				MatrixXA p=MatrixXA::Zero(nk*3, nB*4), pp=MatrixXA::Zero(nk*3, nB*4), vb;
+				for (int c=0; c<tiles.nVertexBlocks(); c++) {
+					vb=tiles.tile(b, c).template cast<AccScalar>();
+					p.noalias()+=vb*wu[s].middleRows(tiles.vertexStart(c), tiles.vertexCount(c));
+					pp.noalias()+=vb*wpu[s].middleRows(tiles.vertexStart(c), tiles.vertexCount(c));
+				}
+				MatrixXA vuTk(4, nB*4);
+				for (int kk=0; kk<nk; kk++) {
+					int k=k0+kk;
+					vuTk.topRows(3)=p.middleRows(kk*3, 3);
+					vuTk.row(3)=wuSum.row(s);
+					for (int j=0; j<nB; j++)
+						if (wpuSum(s, j*4+3)!=0) {
+							AccScalar a=transAffine*wuSum(s, j*4+3)/wpuSum(s, j*4+3);
+							vuTk.block(0, j*4, 3, 4)+=a*pp.block(kk*3, j*4, 3, 4);
+							vuTk.row(3).segment(j*4, 4)+=a*wpuSum.row(s).segment(j*4, 4);
+						}
+					vuT.middleRows(k*4, 4)=vuTk.template cast<_Scalar>();
+				}
+			}
+		});
+	}
 	
 	//! uuT is a sparse block matrix, uuT(j, k).block<4, 4>(s*4, 0) = \sum{i=0}{nV-1} w(j, i)*w(k, i)*u.col(i).segment<3>(s*3).homogeneous().transpose()*u.col(i).segment<3>(s*3).homogeneous()
 	struct SparseMatrixBlock {
@@ -926,58 +2024,130 @@ public:
 		Eigen::VectorXi innerIdx, outerIdx;
 	} uuT;
 
+	//! Packed symmetric 4*4 matrix, the lower triangle stored column by column
+	using VectorP=Eigen::Matrix<_Scalar, 10, 1>;
+
+	/** Packed outer product of a homogeneous position
+		@param _u is the 4*1 vector
+		@return the lower triangle of @p _u*@p _u^T in the packed order (0, 0), (1, 0), (2, 0), (3, 0), (1, 1), (2, 1), (3, 1), (2, 2), (3, 2), (3, 3)
+	*/
+	template<class Derived>
+	static Eigen::Matrix<typename Derived::Scalar, 10, 1> packOuter(const Eigen::MatrixBase<Derived>& _u) {
+		Eigen::Matrix<typename Derived::Scalar, 10, 1> p;
+		int n=0;
+		for (int c=0; c<4; c++)
+			for (int r=c; r<4; r++) p(n++)=_u(r)*_u(c);
+		return p;
+	}
+
+	/** Unpack a symmetric 4*4 matrix
+		@param p is the packed lower triangle, see packOuter()
+		@param a is the by-reference output symmetric matrix
+	*/
+	template<class Derived>
+	static void unpackSym(const VectorP& p, Eigen::MatrixBase<Derived> const& a) {
+		Eigen::MatrixBase<Derived>& _a=const_cast<Eigen::MatrixBase<Derived>&>(a);
+		int n=0;
+		for (int c=0; c<4; c++)
+			for (int r=c; r<4; r++) _a(r, c)=_a(c, r)=p(n++);
+	}
+
+	//! Block indices of uuT, uuTPos(@p i, @p j) is the block index of the pair of bones (@p i, @p j) or -1 if not overlapping
+	Eigen::MatrixXi uuTPos;
+	//! Sparsity pattern of #w used to build #uuTPos
+	Eigen::VectorXi uuTwOuter, uuTwInner;
+
 	/** Pre-compute uuT for bone transformations update
+		@details Each thread accumulates the packed lower triangles of the blocks in a private buffer, the buffers are reduced once at the end.
+			The block pattern #uuTPos is rebuilt only when the support of #w has changed since the last call.
 	*/
 	void compute_uuT() {
-		Eigen::MatrixXi pos=Eigen::MatrixXi::Constant(nB, nB, -1);
-		#pragma omp parallel for
-		for (int i=0; i<nV; i++)
-			for (typename SparseMatrix::InnerIterator it(w, i); it; ++it)
-				for (typename SparseMatrix::InnerIterator jt(w, i); jt; ++jt)
-					pos(it.row(), jt.row())=1;
-
-		uuT.outerIdx.resize(nB+1);
-		uuT.innerIdx.resize(nB*nB);
-		int nnz=0;
-		for (int j=0; j<nB; j++) {
-			uuT.outerIdx(j)=nnz;
-			for (int i=0; i<nB; i++)
-				if (pos(i, j)!=-1) {
-					uuT.innerIdx(nnz)=i;
-					pos(i, j)=nnz++;
-				}
+		w.makeCompressed();
+		bool samePattern=(uuTPos.rows()==nB)&&(uuTwOuter.size()==w.outerSize()+1)&&(uuTwInner.size()==w.nonZeros())&&
+			std::equal(uuTwOuter.data(), uuTwOuter.data()+uuTwOuter.size(), w.outerIndexPtr())&&
+			std::equal(uuTwInner.data(), uuTwInner.data()+uuTwInner.size(), w.innerIndexPtr());
+
+		if (!samePattern) {
+			uuTPos=Eigen::MatrixXi::Constant(nB, nB, -1);
+			#pragma omp parallel for
+			for (int i=0; i<nV; i++)
+				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it)
+					for (typename SparseMatrix::InnerIterator jt(w, i); jt; ++jt)
+						uuTPos(it.row(), jt.row())=1;
+
+			uuT.outerIdx.resize(nB+1);
+			uuT.innerIdx.resize(nB*nB);
+			int nnz=0;
+			for (int j=0; j<nB; j++) {
+				uuT.outerIdx(j)=nnz;
+				for (int i=0; i<nB; i++)
+					if (uuTPos(i, j)!=-1) {
+						uuT.innerIdx(nnz)=i;
+						uuTPos(i, j)=nnz++;
+					}
+			}
+			uuT.outerIdx(nB)=nnz;
+			uuT.innerIdx.conservativeResize(nnz);
+
+			uuTwOuter=Eigen::Map<const Eigen::VectorXi>(w.outerIndexPtr(), w.outerSize()+1);
+			uuTwInner=Eigen::Map<const Eigen::VectorXi>(w.innerIndexPtr(), w.nonZeros());
 		}
-		uuT.outerIdx(nB)=nnz;
-		uuT.innerIdx.conservativeResize(nnz);
-		uuT.val=MatrixX::Zero(nS*4, nnz*4);
 
-		#pragma omp parallel for
-		for (int i=0; i<nV; i++)
-			for (typename SparseMatrix::InnerIterator it(w, i); it; ++it)
-				for (typename SparseMatrix::InnerIterator jt(w, i); jt; ++jt)
-					if (it.row()>=jt.row()) {
-						double _w=it.value()*jt.value();
-						MatrixX _uuT(4*nS, 4);
-						Vector4 _u;
-						for (int s=0; s<nS; s++) {
-							_u=u.vec3(s, i).homogeneous();
-							_uuT.blk4(s, 0)=_w*_u*_u.transpose();
+		int nBlk=uuT.outerIdx(nB);
+		std::vector<MatrixXA, Eigen::aligned_allocator<MatrixXA>> acc;
+		#pragma omp parallel
+		{
+			MatrixXA accT=MatrixXA::Zero(10*nS, nBlk);
+			MatrixXA pu(10, nS);
+			#pragma omp for nowait
+			for (int i=0; i<nV; i++) {
+				for (int s=0; s<nS; s++) pu.col(s)=packOuter(u.vec3(s, i).homogeneous()).template cast<AccScalar>();
+				for (typename SparseMatrix::InnerIterator it(w, i); it; ++it)
+					for (typename SparseMatrix::InnerIterator jt(w, i); jt; ++jt)
+						if (it.row()>=jt.row()) {
+							AccScalar _w=AccScalar(it.value())*jt.value();
+							int p=uuTPos(it.row(), jt.row());
+							for (int s=0; s<nS; s++) accT.col(p).segment(s*10, 10)+=_w*pu.col(s);
 						}
-						int p=pos(it.row(), jt.row())*4;
-						for (int c=0; c<4; c++)
-							for (int r=0; r<4*nS; r++)
-								#pragma omp atomic
-								uuT.val(r, p+c)+=_uuT(r, c);
-					}
+			}
+			#pragma omp critical
+			acc.push_back(std::move(accT));
+		}
 
-		for (int i=0; i<nB; i++)
-			for (int j=i+1; j<nB; j++)
-				if (pos(i, j)!=-1)
-					uuT.val.middleCols(pos(i, j)*4, 4)=uuT.val.middleCols(pos(j, i)*4, 4);
+		int nAcc=(int)acc.size();
+		uuT.val.resize(nS*4, nBlk*4);
+		#pragma omp parallel for
+		for (int j=0; j<nB; j++)
+			for (int it=uuT.outerIdx(j); it<uuT.outerIdx(j+1); it++) {
+				int i=uuT.innerIdx(it);
+				int p=uuTPos(std::max(i, j), std::min(i, j));
+				Eigen::Matrix<AccScalar, 10, 1> sum;
+				for (int s=0; s<nS; s++) {
+					sum.setZero();
+					for (int t=0; t<nAcc; t++) sum+=acc[t].col(p).template segment<10>(s*10);
+					unpackSym(VectorP(sum.template cast<_Scalar>()), uuT.val.blk4(s, it));
+				}
+			}
 	}
 
 
 
+	//! Packed mTm for the contractions in compute_aTa(), mTmP.@a col(@p i*#nB+@p j).@a segment<10>(@p s*10) is packQuad() of #mTm.@a blk4(@p s*#nB+@p i, @p j)
+	MatrixX mTmP;
+
+	/** Packed quadratic form of a 4*4 matrix
+		@param a is the 4*4 matrix
+		@return the vector p such that @p x^T*@p a*@p x = p.dot(packOuter(@p x)) for any @p x
+	*/
+	template<class Derived>
+	static Eigen::Matrix<typename Derived::Scalar, 10, 1> packQuad(const Eigen::MatrixBase<Derived>& a) {
+		Eigen::Matrix<typename Derived::Scalar, 10, 1> p;
+		int n=0;
+		for (int c=0; c<4; c++)
+			for (int r=c; r<4; r++) p(n++)=(r==c)?a(r, c):a(r, c)+a(c, r);
+		return p;
+	}
+
 	/** Pre-compute mTm for weights update
 	*/
 	void compute_mTm() {
@@ -996,138 +2166,684 @@ public:
 			int i=idx(0, p);
 			int j=idx(1, p);
 			for (int k=0; k<nF; k++)
-				mTm.blk4(subjectID(k)*nB+i, j)+=m.blk4(k, i).template topRows<3>().transpose()*m.blk4(k, j).template topRows<3>();
+				mTm.blk4(subjectID(k)*nB+i, j)+=frameWeightOf(k)*m.blk4(k, i).template topRows<3>().transpose()*m.blk4(k, j).template topRows<3>();
 			if (i!=j) for (int s=0; s<nS; s++) mTm.blk4(s*nB+j, i)=mTm.blk4(s*nB+i, j);
 		}
+
+		mTmP.resize(nS*10, nB*nB);
+		#pragma omp parallel for
+		for (int p=0; p<nPairs; p++) {
+			int i=idx(0, p);
+			int j=idx(1, p);
+			for (int s=0; s<nS; s++) mTmP.col(i*nB+j).template segment<10>(s*10)=packQuad(mTm.blk4(s*nB+i, j));
+			mTmP.col(j*nB+i)=mTmP.col(i*nB+j);
+		}
+	}
+
+	/** Candidate bones, boneCand.@a col(@p i) are the bones in #keep_bones considered for vertex @p i: the bones with non-zero weights #w on @p i,
+		then the bones whose rest pose centroids are the nearest to #u.@a col(@p i), up to #nCandBones bones
+	*/
+	Eigen::MatrixXi boneCand;
+
+	/** Pre-compute candidate bones from the rest pose bone centroids
+		@details The centroid of bone @p j is the average of #u weighted by #w(@p j, .). With a few hundreds of bones a linear scan of the centroids
+		per vertex is cheaper than a spatial tree, the memory is O(#nV*#nCandBones) either way.
+	*/
+	void compute_boneCand() {
+		int nK=int(keep_bones.size());
+		int nC=((nCandBones<=0)||(nCandBones>nK))?nK:nCandBones;
+		boneCand.resize(nC, nV);
+		if (nC==nK) {
+			#pragma omp parallel for
+			for (int i=0; i<nV; i++) boneCand.col(i)=keep_bones;
+			return;
+		}
+
+		MatrixX cu=MatrixX::Zero(nS*3, nB);
+		VectorX sw=VectorX::Zero(nB);
+		for (int i=0; i<nV; i++)
+			for (typename SparseMatrix::InnerIterator it(w, i); it; ++it) {
+				cu.col(it.row())+=it.value()*u.col(i);
+				sw(it.row())+=it.value();
+			}
+		for (int j=0; j<nB; j++) if (sw(j)>0) cu.col(j)/=sw(j);
+
+		std::vector<char> keep(nB, 0);
+		for (int k=0; k<nK; k++) keep[keep_bones(k)]=1;
+
+		#pragma omp parallel
+		{
+			std::vector<char> used(nB, 0);
+			Eigen::VectorXi idx(nK);
+			VectorX d(nB);
+			#pragma omp for
+			for (int i=0; i<nV; i++) {
+				int n=0;
+				for (typename SparseMatrix::InnerIterator it(w, i); it&&(n<nC); ++it)
+					if (keep[it.row()]&&(it.value()>0)) {
+						boneCand(n++, i)=int(it.row());
+						used[it.row()]=1;
+					}
+
+				int nd=0;
+				for (int k=0; k<nK; k++) {
+					int j=keep_bones(k);
+					if (used[j]) continue;
+					d(j)=(sw(j)>0)?(u.col(i)-cu.col(j)).squaredNorm():std::numeric_limits<_Scalar>::max();
+					idx(nd++)=j;
+				}
+				int nn=nC-n;
+				std::partial_sort(idx.data(), idx.data()+nn, idx.data()+nd, [&d](int j1, int j2) { return d(j1)<d(j2); });
+				boneCand.col(i).segment(n, nn)=idx.head(nn);
+
+				for (int c=0; c<n; c++) used[boneCand(c, i)]=0;
+			}
+		}
+	}
+
+	//! Candidate bones of the weights update, wCand.@a col(@p i) = #boneCand.@a col(@p i).@a head(#nnz) are the candidates with the smallest fitting errors #ErrVtxBoneAll to vertex @p i, sorted by increasing error
+	Eigen::MatrixXi wCand;
+
+	/** Pre-compute candidate bones for weights update, #boneCand and #ErrVtxBoneAll are sorted by increasing error
+	*/
+	void compute_wCand() {
+		if ((boneCand.cols()!=nV)||(ErrVtxBoneAll.cols()!=nV)) compute_errorVtxBoneALL();
+		int nC=int(boneCand.rows());
+		int nnzi=std::min(nnz, nC);
+		wCand.resize(nnzi, nV);
+		#pragma omp parallel
+		{
+			Eigen::VectorXi idx(nC), cand(nC);
+			VectorXA err(nC);
+			#pragma omp for
+			for (int i=0; i<nV; i++) {
+				for (int c=0; c<nC; c++) idx(c)=c;
+				std::sort(idx.data(), idx.data()+nC, [this, i](int c1, int c2) { return ErrVtxBoneAll(c1, i)<ErrVtxBoneAll(c2, i); });
+				for (int c=0; c<nC; c++) {
+					cand(c)=boneCand(idx(c), i);
+					err(c)=ErrVtxBoneAll(idx(c), i);
+				}
+				boneCand.col(i)=cand;
+				ErrVtxBoneAll.col(i)=err;
+				wCand.col(i)=cand.head(nnzi);
+			}
+		}
 	}
 
-	//! aTb.col(i) is the A^Tb for vertex i, where A.size = (3*nF, nB), A.col(j).segment<3>(f*3) is the transformed position of vertex i by bone j at frame f, b = v.col(i).
+	//! aTb(@p c, @p i) is the A^Tb for vertex @p i and bone #wCand(@p c, @p i), where A.size = (3*nF, nB), A.col(j).segment<3>(f*3) is the transformed position of vertex i by bone j at frame f, b = v.col(i).
 	MatrixX aTb;
 
-	/** Pre-compute aTb for weights update
+	/** Pre-compute aTb for weights update on the candidate bones #wCand
 	*/
 	void compute_aTb() {
+		aTb=MatrixX::Zero(wCand.rows(), nV);
+		if (frameSource) {
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) aTbChunk(fs.frames(), fs.frameStart());
+		} else aTbChunk(v, 0);
+	}
+
+	/** Accumulate #aTb over a block of frames
+		@param vb is the block of frames, [@c size] = [3*@p nk, #nV]
+		@param k0 is the first frame of the block
+	*/
+	template<class Derived>
+	void aTbChunk(const Eigen::MatrixBase<Derived>& vb, int k0) {
+		int nk=int(vb.rows())/3;
 		#pragma omp parallel for
 		for (int i=0; i<nV; i++)
-			for (int j=0; j<nB; j++)
-				if ((aTb(j, i)==0)&&(ws(j, i)>weightEps))
-					for (int k=0; k<nF; k++)
-						aTb(j, i)+=v.vec3(k, i).template cast<_Scalar>().dot(m.blk4(k, j).template topRows<3>()*u.vec3(subjectID(k), i).homogeneous());
+			for (int c=0; c<wCand.rows(); c++) {
+				int j=wCand(c, i);
+				_Scalar sum=0;
+				for (int kk=0; kk<nk; kk++) {
+					int k=k0+kk;
+					sum+=frameWeightOf(k)*vb.vec3(kk, i).template cast<_Scalar>().dot(m.blk4(k, j).template topRows<3>()*u.vec3(subjectID(k), i).homogeneous());
+				}
+				aTb(c, i)+=sum;
+			}
 	}
 
 	//! Size of the model=RMS distance to centroid
 	_Scalar modelSize;
 	
-	//! Laplacian matrix
-	SparseMatrix laplacian;
+	/** Symmetric smoothing system, #laplacian = #weightsSmoothStep*@p L + @p D, with @p L the weighted graph Laplacian of the mesh and @p D its
+		degree matrix (1 for isolated vertices), its sparsity pattern is the mesh graph with the diagonal
+		@details It is the system (#weightsSmoothStep*@p D^-1*@p L + @p I) @p ws = @p w of the smoothed weights multiplied by @p D, see #smoothScale.
+	*/
+	SparseMatrixA laplacian;
+
+	//! Diagonal of @p D, the right-hand side of the smoothing system is #smoothScale.@a asDiagonal()*@p w
+	VectorXA smoothScale;
 
-	//! LU factorization of Laplacian
-	Eigen::SparseLU<SparseMatrix> smoothSolver;
+	//! LDLT factorization of #laplacian
+	CachedLDLT<SparseMatrixA> smoothSolver;
 
-	/** Pre-compute Laplacian and LU factorization
+	/** Pre-compute Laplacian and LDLT factorization, or load them from #smoothCacheDir
 	*/
 	void computeSmoothSolver() {
+		std::string cacheFile;
+		if (!smoothCacheDir.empty()) {
+			cacheFile=smoothCacheFile();
+			if (loadSmoothSolver(cacheFile)) {
+				wsPrevT.resize(0, 0);
+				return;
+			}
+		}
+
 		int nFV=(int)fv.size();
 
-		_Scalar epsDis=0;
+		AccScalar epsDis=0;
 		for (int f=0; f<nFV; f++) {
 			int nf=(int)fv[f].size();
 			for (int g=0; g<nf; g++) {
 				int i=fv[f][g];
 				int j=fv[f][(g+1)%nf];
-				epsDis+=(u.col(i)-u.col(j)).norm();
+				epsDis+=(u.col(i)-u.col(j)).template cast<AccScalar>().norm();
 			}
 		}
-		epsDis=epsDis*weightEps/(_Scalar)nS;
+		epsDis=epsDis*weightEps/(AccScalar)nS;
 
-		std::vector<Triplet, Eigen::aligned_allocator<Triplet>> triplet;
-		VectorX d=VectorX::Zero(nV);
-		std::vector<std::set<int>> isComputed(nV);
+		std::vector<std::pair<int, int>> edgeList;
+		meshEdges(fv, nV, edgeList);
+		int nE=int(edgeList.size());
+		Eigen::MatrixXi edge(2, nE);
+		#pragma omp parallel for
+		for (int e=0; e<nE; e++) {
+			edge(0, e)=edgeList[e].first;
+			edge(1, e)=edgeList[e].second;
+		}
 
+		//Edge length deviations from the rest poses, accumulated over the frames
+		MatrixXA du(nS, nE);
 		#pragma omp parallel for
-		for (int f=0; f<nFV; f++) {
-			int nf=(int)fv[f].size();
-			for (int g=0; g<nf; g++) {
-				int i=fv[f][g];
-				int j=fv[f][(g+1)%nf];
+		for (int e=0; e<nE; e++)
+			for (int s=0; s<nS; s++) du(s, e)=(u.vec3(s, edge(0, e))-u.vec3(s, edge(1, e))).template cast<AccScalar>().norm();
+		VectorXA val=VectorXA::Zero(nE);
+		if (frameSource) {
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) edgeStatsChunk(fs.frames(), fs.frameStart(), edge, du, val);
+		} else edgeStatsChunk(v, 0, edge, du, val);
 
-				bool needCompute=false;
-				#pragma omp critical 
-				if (isComputed[i].find(j)==isComputed[i].end()) {
-					needCompute=true;
-					isComputed[i].insert(j);
-					isComputed[j].insert(i);
-				}
+		#pragma omp parallel for
+		for (int e=0; e<nE; e++) val(e)=1/(sqrt(val(e)/totalFrameWeight())+epsDis);
+
+		Eigen::VectorXi deg=Eigen::VectorXi::Zero(nV);
+		smoothScale=VectorXA::Zero(nV);
+		for (int e=0; e<nE; e++) {
+			deg(edge(0, e))++;
+			deg(edge(1, e))++;
+			smoothScale(edge(0, e))+=val(e);
+			smoothScale(edge(1, e))+=val(e);
+		}
+		for (int i=0; i<nV; i++) if (smoothScale(i)==0) smoothScale(i)=1;
 
-				if (needCompute) {
-					double val=0;
-					for (int s=0; s<nS; s++) {
-						double du=(u.vec3(s, i)-u.vec3(s, j)).norm();
-						for (int k=fStart(s); k<fStart(s+1); k++)
-							val+=pow((v.vec3(k, i).template cast<_Scalar>()-v.vec3(k, j).template cast<_Scalar>()).norm()-du, 2);
-					}
-					val=1/(sqrt(val/nF)+epsDis);
+		//Compressed columns sorted by row: the edges to smaller vertices, the diagonal, then the edges to larger vertices
+		using StorageIndex=typename SparseMatrixA::StorageIndex;
+		laplacian.resize(nV, nV);
+		StorageIndex* outer=laplacian.outerIndexPtr();
+		outer[0]=0;
+		for (int i=0; i<nV; i++) outer[i+1]=outer[i]+deg(i)+1;
+		laplacian.resizeNonZeros(outer[nV]);
+		StorageIndex* inner=laplacian.innerIndexPtr();
+		AccScalar* value=laplacian.valuePtr();
+		AccScalar step=AccScalar(weightsSmoothStep);
+		Eigen::VectorXi pos=Eigen::Map<Eigen::Matrix<StorageIndex, Eigen::Dynamic, 1>>(outer, nV).template cast<int>();
+		for (int e=0; e<nE; e++) {
+			int p=pos(edge(1, e))++;
+			inner[p]=edge(0, e);
+			value[p]=-step*val(e);
+		}
+		for (int i=0; i<nV; i++) {
+			int p=pos(i)++;
+			inner[p]=i;
+			value[p]=((deg(i)>0)?step*smoothScale(i):0)+smoothScale(i);
+		}
+		for (int e=0; e<nE; e++) {
+			int p=pos(edge(0, e))++;
+			inner[p]=edge(1, e);
+			value[p]=-step*val(e);
+		}
 
-					#pragma omp critical
-					triplet.push_back(Triplet(i, j, -val));
-					#pragma omp atomic
-					d(i)+=val;
+		smoothSolver.compute(laplacian);
+		wsPrevT.resize(0, 0);
+		if (!cacheFile.empty()) saveSmoothSolver(cacheFile);
+	}
 
-					#pragma omp critical
-					triplet.push_back(Triplet(j, i, -val));
-					#pragma omp atomic
-					d(j)+=val;
-				}
-			}
+	/** @return key of the cache entry of computeSmoothSolver(), a hash of #fv, #u, the sequence (#v or #frameSource), #fStart, #frameWeight, #weightsSmoothStep and #weightEps
+		@details The sequence is hashed per vertex in parallel, it is read once from #frameSource.
+	*/
+	std::uint64_t smoothCacheKey() {
+		Hash64 h;
+		h.add(std::int32_t(sizeof(AccScalar)));
+		h.add(std::int32_t(sizeof(_AniMeshScalar)));
+		h.add(nV);
+		h.add(nF);
+		h.addMatrix(fStart);
+		if (frameWeight.size()==nF) h.addMatrix(frameWeight);
+		h.add(std::int64_t(fv.size()));
+		for (const auto& f: fv) {
+			h.add(std::int32_t(f.size()));
+			h.add(f.data(), sizeof(int)*f.size());
 		}
+		h.addMatrix(u);
+		h.add(weightsSmoothStep);
+		h.add(weightEps);
+
+		std::vector<Hash64> hv(nV);
+		if (frameSource) {
+			for (FrameStream<_AniMeshScalar> fs(*frameSource, fStart, streamChunkSize); fs.next(); ) sequenceHashChunk(fs.frames(), hv);
+		} else sequenceHashChunk(v, hv);
+		for (int i=0; i<nV; i++) h.add(hv[i].value());
+		return h.value();
+	}
 
+	/** Hash a block of frames of the sequence per vertex, see smoothCacheKey()
+		@param vb is the block of frames, [@c size] = [3*@p nk, #nV]
+		@param hv is the by-reference hashes of the vertices
+	*/
+	template<class Derived>
+	void sequenceHashChunk(const Eigen::MatrixBase<Derived>& vb, std::vector<Hash64>& hv) {
+		int nr=int(vb.rows());
+		#pragma omp parallel for
 		for (int i=0; i<nV; i++)
-			triplet.push_back(Triplet(i, i, d(i)));
+			for (int r=0; r<nr; r++) {
+				_AniMeshScalar x=vb(r, i);
+				hv[i].add(x);
+			}
+	}
 
-		laplacian.resize(nV, nV);
-		laplacian.setFromTriplets(triplet.begin(), triplet.end());
+	//! @return file name of the cache entry of computeSmoothSolver() in #smoothCacheDir
+	std::string smoothCacheFile() {
+		char key[17];
+		std::snprintf(key, sizeof(key), "%016llx", (unsigned long long)smoothCacheKey());
+		return smoothCacheDir+"/smooth_"+key+".bin";
+	}
 
-		for (int i=0; i<nV; i++)
-			if (d(i)!=0) laplacian.row(i)/=d(i);
+	//! Magic number of the cache files of computeSmoothSolver()
+	static constexpr const char* smoothCacheMagic() { return "DEMBSMO1"; }
 
-		laplacian=weightsSmoothStep*laplacian+SparseMatrix((VectorX::Ones(nV)).asDiagonal());
-		smoothSolver.compute(laplacian);
+	/** Load #laplacian, #smoothScale and #smoothSolver from a cache file written by saveSmoothSolver()
+		@return true if success
+	*/
+	bool loadSmoothSolver(const std::string& fileName) {
+		std::ifstream in(fileName, std::ios::binary);
+		if (!in) return false;
+		char magic[8];
+		if (!in.read(magic, 8)||(std::memcmp(magic, smoothCacheMagic(), 8)!=0)) return false;
+		if (readBinary(in, laplacian)&&readBinary(in, smoothScale)&&smoothSolver.load(in)&&
+			(laplacian.rows()==nV)&&(laplacian.cols()==nV)&&(smoothScale.size()==nV)&&(smoothSolver.rows()==nV)) return true;
+		laplacian.resize(0, 0);
+		return false;
 	}
 
-	//! Smoothed skinning weights
+	/** Write #laplacian, #smoothScale and #smoothSolver to a cache file, through a temporary file renamed once complete
+		@return true if success
+	*/
+	bool saveSmoothSolver(const std::string& fileName) {
+		std::string tmp=fileName+"."+std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())+".tmp";
+		{
+			std::ofstream out(tmp, std::ios::binary);
+			if (!out) return false;
+			out.write(smoothCacheMagic(), 8);
+			writeBinary(out, laplacian);
+			writeBinary(out, smoothScale);
+			if (!smoothSolver.save(out)||!out) {
+				out.close();
+				std::remove(tmp.c_str());
+				return false;
+			}
+		}
+		if (std::rename(tmp.c_str(), fileName.c_str())!=0) {
+			std::remove(tmp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	/** Accumulate the squared edge length deviations of computeSmoothSolver() over a block of frames
+		@param vb is the block of frames, [@c size] = [3*@p nk, #nV]
+		@param k0 is the first frame of the block
+		@param edge is the edges, edge.@a col(@p e) are the vertex indices of edge @p e
+		@param du is the rest pose edge lengths, du(@p s, @p e) is the length of edge @p e on subject @p s
+		@param val is the by-reference output, val(@p e) is the sum over the frames of the squared deviation of the length of edge @p e from du
+	*/
+	template<class Derived>
+	void edgeStatsChunk(const Eigen::MatrixBase<Derived>& vb, int k0, const Eigen::MatrixXi& edge, const MatrixXA& du, VectorXA& val) {
+		int nk=int(vb.rows())/3;
+		#pragma omp parallel for
+		for (int e=0; e<int(edge.cols()); e++) {
+			int i=edge(0, e);
+			int j=edge(1, e);
+			AccScalar vale=val(e);
+			for (int kk=0; kk<nk; kk++)
+				vale+=frameWeightOf(k0+kk)*pow((vb.vec3(kk, i).template cast<AccScalar>()-vb.vec3(kk, j).template cast<AccScalar>()).norm()-du(subjectID(k0+kk), e), 2);
+			val(e)=vale;
+		}
+	}
+
+	//! Smoothed skinning weights on the candidate bones, ws(@p c, @p i) is the smoothed weight of bone #boneCand(@p c, @p i) on vertex @p i
 	MatrixX ws;
 
-	/** Implicit skinning weights Laplacian smoothing
+	/** Implicit skinning weights Laplacian smoothing, only the values on the candidate bones #boneCand are kept
+		@details Keeping the candidate bones only bounds the memory of #ws to O(#nV*#nCandBones), it does not reduce the time: without #weightsSmoothRings,
+		every bone with non-zero weights still needs a solve on the whole mesh per call, i.e. O(#nB) global solves, batched by right-hand sides.
 	*/
 	void compute_ws() {
-		ws=w.transpose();
-		#pragma omp parallel for
-		for (int j=0; j<nB; j++) ws.col(j)=smoothSolver.solve(ws.col(j));
-		ws.transposeInPlace();
+		int nC=int(boneCand.rows());
+
+		//Candidate slots of each bone
+		Eigen::VectorXi slotStart=Eigen::VectorXi::Zero(nB+1);
+		for (int i=0; i<nV; i++)
+			for (int c=0; c<nC; c++) slotStart(boneCand(c, i)+1)++;
+		for (int j=0; j<nB; j++) slotStart(j+1)+=slotStart(j);
+		Eigen::VectorXi slotPos=slotStart.head(nB);
+		Eigen::VectorXi slot(nV*nC);
+		for (int i=0; i<nV; i++)
+			for (int c=0; c<nC; c++) slot(slotPos(boneCand(c, i))++)=i*nC+c;
+
+		ws=MatrixX::Zero(nC, nV);
+		SparseMatrix wT=w.transpose();
+		std::vector<int> bone;
+		for (int j=0; j<nB; j++)
+			if ((slotStart(j+1)>slotStart(j))&&(wT.col(j).nonZeros()>0)) bone.push_back(j);
+
+		if (weightsSmoothRings>0) compute_wsLocal(wT, bone, slotStart, slot);
+		else {
+			//Blocks of right-hand sides solved together
+			const int nRHS=8;
+			int nBlk=(int(bone.size())+nRHS-1)/nRHS;
+			#pragma omp parallel
+			{
+				MatrixXA b, x;
+				#pragma omp for schedule(dynamic)
+				for (int blk=0; blk<nBlk; blk++) {
+					int c0=blk*nRHS;
+					int nc=std::min(nRHS, int(bone.size())-c0);
+					b=MatrixXA::Zero(nV, nc);
+					for (int c=0; c<nc; c++)
+						for (typename SparseMatrix::InnerIterator it(wT, bone[c0+c]); it; ++it) b(it.row(), c)=smoothScale(it.row())*AccScalar(it.value());
+					x=smoothSolver.solve(b);
+					for (int c=0; c<nc; c++) {
+						int j=bone[c0+c];
+						for (int p=slotStart(j); p<slotStart(j+1); p++) ws(slot(p)%nC, slot(p)/nC)=_Scalar(x(slot(p)/nC, c));
+					}
+				}
+			}
+		}
 
 		#pragma omp parallel for
 		for (int i=0; i<nV; i++) {
 			ws.col(i)=ws.col(i).cwiseMax(0.0);
 			_Scalar si=ws.col(i).sum();
-			if (si<_Scalar(0.1)) ws.col(i)=VectorX::Constant(nB, _Scalar(1)/nB); else ws.col(i)/=si;
+			if (si<_Scalar(0.1)) ws.col(i)=VectorX::Constant(nC, _Scalar(1)/nC); else ws.col(i)/=si;
 		}
 	}
 
+	//! #w.@a transpose() at the previous call of compute_wsLocal(), empty if its solutions are not valid
+	SparseMatrix wsPrevT;
+	//! Solutions of the previous call of compute_wsLocal(), #wsPrevX[@p j] is the smoothed weights of bone @p j on the neighborhood of its support
+	std::vector<SparseVectorA> wsPrevX;
+	//! #weightsSmoothRings of the previous call of compute_wsLocal()
+	int wsPrevRings;
+
+	/** Smooth the weights of each bone on the #weightsSmoothRings rings around its support with zero weights beyond, see compute_ws()
+		@details The bones whose column of #w is unchanged since the previous call reuse their solution, the others solve the restriction of
+		#laplacian to the neighborhood (or the whole system with #smoothSolver if the neighborhood covers half of the mesh). The solutions are kept
+		as sparse vectors on the neighborhoods, so the cost scales with the sizes of the supports instead of #nV*#nB.
+		@param wT is #w.@a transpose()
+		@param bone is the bones to smooth
+		@param slotStart, slot are the candidate slots of the bones, slot(@p p) = @p i*@p nC+@p c for @p p in [slotStart(@p j), slotStart(@p j+1))
+	*/
+	void compute_wsLocal(const SparseMatrix& wT, const std::vector<int>& bone, const Eigen::VectorXi& slotStart, const Eigen::VectorXi& slot) {
+		int nC=int(boneCand.rows());
+		bool valid=(wsPrevT.rows()==nV)&&(wsPrevRings==weightsSmoothRings);
+		if (!valid) wsPrevX.clear();
+		wsPrevX.resize(nB);
+
+		//@return true if column j of wT is the same as at the previous call
+		auto unchanged=[&](int j) {
+			if (!valid||(j>=wsPrevT.cols())) return false;
+			int p0=wT.outerIndexPtr()[j], n=wT.outerIndexPtr()[j+1]-p0;
+			int q0=wsPrevT.outerIndexPtr()[j];
+			return (n==wsPrevT.outerIndexPtr()[j+1]-q0)&&(wsPrevX[j].size()==nV)&&
+				std::equal(wT.innerIndexPtr()+p0, wT.innerIndexPtr()+p0+n, wsPrevT.innerIndexPtr()+q0)&&
+				std::equal(wT.valuePtr()+p0, wT.valuePtr()+p0+n, wsPrevT.valuePtr()+q0);
+		};
+		std::vector<char> keep(bone.size());
+		for (int b=0; b<(int)bone.size(); b++) keep[b]=unchanged(bone[b]);
+
+		#pragma omp parallel
+		{
+			Eigen::VectorXi local=Eigen::VectorXi::Constant(nV, -1);
+			VectorXA x=VectorXA::Zero(nV);
+			std::vector<int> region;
+			std::vector<Eigen::Triplet<AccScalar>> triplet;
+			SparseMatrixA sub;
+			Eigen::SimplicialLDLT<SparseMatrixA> subSolver;
+			#pragma omp for schedule(dynamic)
+			for (int b=0; b<(int)bone.size(); b++) {
+				int j=bone[b];
+				if (!keep[b]) {
+					//Support dilated by rings of the mesh graph
+					region.clear();
+					for (typename SparseMatrix::InnerIterator it(wT, j); it; ++it) {
+						local(it.row())=0;
+						region.push_back((int)it.row());
+					}
+					for (int r=0, r0=0; r<weightsSmoothRings; r++) {
+						int r1=(int)region.size();
+						for (int q=r0; q<r1; q++)
+							for (typename SparseMatrixA::InnerIterator it(laplacian, region[q]); it; ++it)
+								if (local(it.row())==-1) {
+									local(it.row())=0;
+									region.push_back((int)it.row());
+								}
+						r0=r1;
+					}
+					std::sort(region.begin(), region.end());
+					int n=(int)region.size();
+					for (int q=0; q<n; q++) local(region[q])=q;
+
+					VectorXA xr;
+					if (2*n>nV) {
+						VectorXA rhs=VectorXA::Zero(nV);
+						for (typename SparseMatrix::InnerIterator it(wT, j); it; ++it) rhs(it.row())=smoothScale(it.row())*AccScalar(it.value());
+						VectorXA xf=smoothSolver.solve(rhs);
+						xr.resize(n);
+						for (int q=0; q<n; q++) xr(q)=xf(region[q]);
+					} else {
+						triplet.clear();
+						for (int q=0; q<n; q++)
+							for (typename SparseMatrixA::InnerIterator it(laplacian, region[q]); it; ++it)
+								if (local(it.row())!=-1) triplet.push_back(Eigen::Triplet<AccScalar>(local(it.row()), q, it.value()));
+						sub.resize(n, n);
+						sub.setFromTriplets(triplet.begin(), triplet.end());
+						subSolver.compute(sub);
+						VectorXA rhs=VectorXA::Zero(n);
+						for (typename SparseMatrix::InnerIterator it(wT, j); it; ++it) rhs(local(it.row()))=smoothScale(it.row())*AccScalar(it.value());
+						xr=subSolver.solve(rhs);
+					}
+
+					SparseVectorA& xs=wsPrevX[j];
+					xs.resize(nV);
+					xs.setZero();
+					xs.reserve(n);
+					for (int q=0; q<n; q++) {
+						xs.insertBack(region[q])=xr(q);
+						local(region[q])=-1;
+					}
+				}
+
+				for (typename SparseVectorA::InnerIterator it(wsPrevX[j]); it; ++it) x(it.index())=it.value();
+				for (int p=slotStart(j); p<slotStart(j+1); p++) ws(slot(p)%nC, slot(p)/nC)=_Scalar(x(slot(p)/nC));
+				for (typename SparseVectorA::InnerIterator it(wsPrevX[j]); it; ++it) x(it.index())=0;
+			}
+		}
+
+		//Solutions of the bones not smoothed are not kept
+		std::vector<char> smoothed(nB, 0);
+		for (int j: bone) smoothed[j]=1;
+		for (int j=0; j<nB; j++) if (!smoothed[j]) wsPrevX[j].resize(0);
+		wsPrevT=wT;
+		wsPrevRings=weightsSmoothRings;
+	}
+
 	//! Per-vertex weights solver
 	ConvexLS<_Scalar> wSolver;
+	//! Per-vertex weights solvers for at most 4 and 8 candidate bones
+	ConvexLSFixed<_Scalar, 4> wSolver4;
+	ConvexLSFixed<_Scalar, 8> wSolver8;
 
 	/** Pre-compute aTa for weights update on one vertex
 		@param i is the vertex index.
-		@param aTa is the by-reference output of A^TA for vertex i, where A.size = (3*nF, nB), A.col(j).segment<3>(f*3) is the transformed position of vertex i by bone j at frame f.
-	*/
-	void compute_aTa(int i, MatrixX& aTa) {
-		aTa=MatrixX::Zero(nB, nB);
-		for (int j1=0; j1<nB; j1++)
-			for (int j2=j1; j2<nB; j2++) {
-				for (int s=0; s<nS; s++) aTa(j1, j2)+=u.vec3(s, i).homogeneous().dot(mTm.blk4(s*nB+j1, j2)*u.vec3(s, i).homogeneous());
-				if (j1!=j2) aTa(j2, j1)=aTa(j1, j2);
+		@param idx is the vector of bone indices
+		@param aTa is the by-reference output of A^TA for vertex i, size = (idx.size(), idx.size()), where A.size = (3*nF, idx.size()), A.col(c).segment<3>(f*3) is the transformed position of vertex i by bone idx(c) at frame f.
+	*/
+	template<class IndexType>
+	void compute_aTa(int i, const IndexType& idx, Eigen::Ref<MatrixX> aTa) {
+		int n=int(idx.size());
+		aTa.setZero();
+		for (int s=0; s<nS; s++) {
+			VectorP pu=packOuter(u.vec3(s, i).homogeneous());
+			for (int c1=0; c1<n; c1++)
+				for (int c2=c1; c2<n; c2++) aTa(c1, c2)+=mTmP.col(idx(c1)*nB+idx(c2)).template segment<10>(s*10).dot(pu);
+		}
+		for (int c1=0; c1<n; c1++)
+			for (int c2=c1+1; c2<n; c2++) aTa(c2, c1)=aTa(c1, c2);
+	}
+
+	//! Workspace slots of the per-vertex weights update, after the slots used by ConvexLS
+	enum { WS_ATA=ConvexLS<_Scalar>::WS_END, WS_ATB, WS_X };
+
+	//! Per-thread workspaces of the weights update
+	std::vector<Workspace<_Scalar>> weightsWorkspace;
+
+	//! Number of heap allocations made by the per-thread workspaces in the last weights update iteration, including the QR fallbacks of ConvexLS, 0 in the steady state of well-conditioned solves
+	long long weightsAllocs;
+
+	//! @return total number of heap allocations made by the per-thread workspaces
+	long long workspaceAllocs() const {
+		long long n=0;
+		for (const auto& wk: weightsWorkspace) n+=wk.nAllocs;
+		return n;
+	}
+
+	/** Unique edges of a mesh, sorted by (smaller vertex, larger vertex)
+		@details The faces are traversed in parallel into per-thread lists split by ranges of the smaller vertex,
+		then the lists of each range are merged, sorted and made unique in parallel.
+		@param fv is the topology of the mesh, see #fv
+		@param n is the number of vertices
+		@param edgeList is the by-reference output
+	*/
+	static void meshEdges(const std::vector<std::vector<int>>& fv, int n, std::vector<std::pair<int, int>>& edgeList) {
+		int nT=maxThreads();
+		std::vector<std::vector<std::pair<int, int>>> part(nT*nT);
+		#pragma omp parallel
+		{
+			int t=threadNum();
+			#pragma omp for
+			for (int f=0; f<(int)fv.size(); f++) {
+				int nf=(int)fv[f].size();
+				for (int g=0; g<nf; g++) {
+					int i=fv[f][g];
+					int j=fv[f][(g+1)%nf];
+					if (i!=j) part[t*nT+int((long long)std::min(i, j)*nT/n)].push_back(std::make_pair(std::min(i, j), std::max(i, j)));
+				}
+			}
+		}
+
+		std::vector<std::vector<std::pair<int, int>>> range(nT);
+		#pragma omp parallel for schedule(dynamic)
+		for (int r=0; r<nT; r++) {
+			for (int t=0; t<nT; t++) {
+				range[r].insert(range[r].end(), part[t*nT+r].begin(), part[t*nT+r].end());
+				std::vector<std::pair<int, int>>().swap(part[t*nT+r]);
 			}
+			std::sort(range[r].begin(), range[r].end());
+			range[r].erase(std::unique(range[r].begin(), range[r].end()), range[r].end());
+		}
+
+		std::vector<std::size_t> offset(nT+1, 0);
+		for (int r=0; r<nT; r++) offset[r+1]=offset[r]+range[r].size();
+		edgeList.resize(offset[nT]);
+		#pragma omp parallel for
+		for (int r=0; r<nT; r++) std::copy(range[r].begin(), range[r].end(), edgeList.begin()+offset[r]);
+	}
+
+	//! @return uniform random number in [0, 1) from the counter @p z
+	static double uniform01(std::uint64_t z) {
+		z+=0x9e3779b97f4a7c15ull;
+		z=(z^(z>>30))*0xbf58476d1ce4e5b9ull;
+		z=(z^(z>>27))*0x94d049bb133111ebull;
+		z^=z>>31;
+		return double(z>>11)/9007199254740992.0;
+	}
+
+	//! @return maximum number of OpenMP threads, 1 without OpenMP
+	static int maxThreads() {
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+	//! @return OpenMP thread number, 0 without OpenMP
+	static int threadNum() {
+#ifdef _OPENMP
+		return omp_get_thread_num();
+#else
+		return 0;
+#endif
+	}
+};
+
+/** @class DemBones::ReducedSolver DemBones.h "DemBones/DemBones.h"
+	@brief Solver of a reduced problem of a DemBones solver, e.g. a coarse mesh of computeCoarseLevels() or the representative frames of computeRepFrames()
+	@details It takes the parameters of the full solver and forwards the callbacks to it, except cbIterBegin() and cbIterEnd() on a coarse mesh
+	whose data are the full problem. On representative frames, cbIterEnd() is forwarded after the results are taken by DemBones::fromRepFrames().
+	The reduced problem stops once a callback of the full solver asks to stop.
+*/
+template<class _Scalar, class _AniMeshScalar>
+class DemBones<_Scalar, _AniMeshScalar>::ReducedSolver: public DemBones<_Scalar, _AniMeshScalar> {
+public:
+	/** Constructor
+		@param full is the full solver, its parameters are copied
+		@param frameRep is the representative of each frame of @p full if the reduced problem is on representative frames, see DemBones::fromRepFrames()
+	*/
+	ReducedSolver(DemBones& full, const Eigen::VectorXi* frameRep=nullptr): full(full), frameRep(frameRep), stopped(false) {
+		this->copyParameters(full);
+	}
+
+	void cbInitSplitBegin() { full.cbInitSplitBegin(); }
+	void cbInitSplitEnd() { full.cbInitSplitEnd(); }
+	void cbIterBegin() {
+		if (frameRep) {
+			full._iter=this->_iter;
+			full.cbIterBegin();
+		}
+	}
+	bool cbIterEnd() {
+		if (frameRep) {
+			full.fromRepFrames(*this, *frameRep);
+			stopped=(stopped||full.cbIterEnd());
+		}
+		return stopped;
 	}
+	void cbWeightsBegin() { full.cbWeightsBegin(); }
+	void cbWeightsEnd() { full.cbWeightsEnd(); }
+	void cbTranformationsBegin() { full.cbTranformationsBegin(); }
+	void cbTransformationsEnd() { full.cbTransformationsEnd(); }
+	void cbTransformationsIterBegin() { full.cbTransformationsIterBegin(); }
+	bool cbTransformationsIterEnd() { return stopped=(stopped||full.cbTransformationsIterEnd()); }
+	void cbWeightsIterBegin() { full.cbWeightsIterBegin(); }
+	bool cbWeightsIterEnd() { return stopped=(stopped||full.cbWeightsIterEnd()); }
+	void cbTiming(const std::string& name, double seconds) { full.cbTiming(name, seconds); }
+
+private:
+	DemBones& full;
+	//! Representative of each frame of #full, nullptr on a coarse mesh
+	const Eigen::VectorXi* frameRep;
+	//! A callback of #full asked to stop
+	bool stopped;
 };
 	
 }
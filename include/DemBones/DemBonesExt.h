@@ -40,6 +40,8 @@ public:
 	using Vector3=Eigen::Matrix<_Scalar, 3, 1>;
 	using SparseMatrix=Eigen::SparseMatrix<_Scalar>;
 	using Triplet=Eigen::Triplet<_Scalar>;
+	using MatrixXA=typename DemBones<_Scalar, _AniMeshScalar>::MatrixXA;
+	using VectorXA=typename DemBones<_Scalar, _AniMeshScalar>::VectorXA;
 
 	using DemBones<_Scalar, _AniMeshScalar>::nIters;
 	using DemBones<_Scalar, _AniMeshScalar>::nInitIters;
@@ -70,6 +72,11 @@ public:
 	using DemBones<_Scalar, _AniMeshScalar>::iterTransformations;
 	using DemBones<_Scalar, _AniMeshScalar>:: iterWeights;
 
+	using DemBones<_Scalar, _AniMeshScalar>::compute_errorTerms;
+	using DemBones<_Scalar, _AniMeshScalar>::errorVtxBoneBlock;
+	using DemBones<_Scalar, _AniMeshScalar>::compute_errorVtxBone;
+	using DemBones<_Scalar, _AniMeshScalar>::frameSource;
+
 	//! Timestamps for bone transformations #m, [@c size] = #nS, #fTime(@p k) is the timestamp of frame @p k
 	Eigen::VectorXd fTime;
 
@@ -223,13 +230,28 @@ private:
 	/** Root joint
 	*/
 	int computeRoot() {
-		VectorX err(nB);
-		#pragma omp parallel for
-		for (int j=0; j<nB; j++) {
-			double ej=0;
-			for (int i=0; i<nV; i++)
-				for (int k=0; k<nF; k++) ej+=(m.rotMat(k, j)*u.vec3(subjectID(k), i)+m.transVec(k, j)-v.vec3(k, i).template cast<_Scalar>()).squaredNorm();
-			err(j)=ej;
+		VectorXA err=VectorXA::Zero(nB);
+		if (frameSource) {
+			//The streamed sequence is read once for all vertex blocks
+			MatrixXA e;
+			compute_errorVtxBone(e);
+			err=e.colwise().sum().transpose();
+		} else {
+			compute_errorTerms();
+			const int nVBlk=256;
+			#pragma omp parallel
+			{
+				MatrixXA e;
+				VectorXA ej=VectorXA::Zero(nB);
+				#pragma omp for schedule(dynamic)
+				for (int i0=0; i0<nV; i0+=nVBlk) {
+					e.resize(std::min(nVBlk, nV-i0), nB);
+					errorVtxBoneBlock(i0, e);
+					ej+=e.colwise().sum().transpose();
+				}
+				#pragma omp critical
+				err+=ej;
+			}
 		}
 		int rj;
 		err.minCoeff(&rj);
@@ -0,0 +1,264 @@
+///////////////////////////////////////////////////////////////////////////////
+//               Dem Bones - Skinning Decomposition Library                  //
+//         Copyright (c) 2019, Electronic Arts. All rights reserved.         //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#ifndef DEM_BONES_FRAME_SOURCE
+#define DEM_BONES_FRAME_SOURCE
+
+#include <Eigen/Dense>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include "FrameTiles.h"
+
+namespace Dem
+{
+
+/** @class FrameSource FrameSource.h "DemBones/FrameSource.h"
+	@brief Out-of-core animated mesh sequence read by blocks of frames
+	@details The sequence is the row-major [3*nFrames(), nVertices()] matrix whose row 3*@p k+@p d is the coordinate @p d of all vertices
+	at frame @p k, i.e. the transpose storage of DemBones::v, so a block of consecutive frames is contiguous.
+
+	@b _AniMeshScalar is the floating-point data type of the sequence.
+*/
+template<class _AniMeshScalar>
+class FrameSource {
+public:
+	virtual ~FrameSource() {}
+
+	//! @return number of frames
+	virtual int nFrames() const=0;
+	//! @return number of vertices
+	virtual int nVertices() const=0;
+
+	/** Read a block of frames, throw std::runtime_error on failure
+		@param[in] k0 is the first frame
+		@param[in] nk is the number of frames
+		@param[out] data is the row-major [3*@p nk, nVertices()] block
+	*/
+	virtual void read(int k0, int nk, _AniMeshScalar* data)=0;
+
+	//! @return pointer to the whole row-major sequence if it is resident in memory, then FrameStream maps it instead of reading chunks, nullptr otherwise
+	virtual const _AniMeshScalar* mapped() const { return nullptr; }
+};
+
+/** @class BufferFrameSource FrameSource.h "DemBones/FrameSource.h"
+	@brief Sequence in a buffer owned by the caller, which must outlive the source, the buffer is never copied as a whole
+	@details The buffer is the [3*nF, nV] sequence in row-major order, then it is mapped by FrameStream, or in column-major order (the layout of
+	DemBones::v), then the chunks are gathered by read().
+*/
+template<class _AniMeshScalar>
+class BufferFrameSource: public FrameSource<_AniMeshScalar> {
+public:
+	/** Constructor
+		@param buffer is the sequence
+		@param nF is the number of frames
+		@param nV is the number of vertices
+		@param rowMajor is the storage order of @p buffer
+	*/
+	BufferFrameSource(const _AniMeshScalar* buffer, int nF, int nV, bool rowMajor): buf(buffer), nF(nF), nV(nV), rowMajor(rowMajor) {}
+
+	int nFrames() const { return nF; }
+	int nVertices() const { return nV; }
+	const _AniMeshScalar* mapped() const { return rowMajor?buf:nullptr; }
+
+	void read(int k0, int nk, _AniMeshScalar* data) {
+		using MatrixC=Eigen::Matrix<_AniMeshScalar, Eigen::Dynamic, Eigen::Dynamic>;
+		using MatrixR=Eigen::Matrix<_AniMeshScalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+		Eigen::Map<MatrixR> out(data, 3*nk, nV);
+		if (rowMajor) out=Eigen::Map<const MatrixR>(buf, 3*nF, nV).middleRows(3*k0, 3*nk);
+		else out=Eigen::Map<const MatrixC>(buf, 3*nF, nV).middleRows(3*k0, 3*nk);
+	}
+
+private:
+	const _AniMeshScalar* buf;
+	int nF, nV;
+	bool rowMajor;
+};
+
+/** @class NpyFrameFile FrameSource.h "DemBones/FrameSource.h"
+	@brief Sequence stored in a .npy file as a C-ordered [3*nF, nV] array, the layout of the vertices array given to the Python module
+*/
+template<class _AniMeshScalar>
+class NpyFrameFile: public FrameSource<_AniMeshScalar> {
+public:
+	NpyFrameFile(): nF(0), nV(0), offset(0) {}
+
+	/** Open the file and parse the header
+		@param fileName is the .npy file name
+		@return true if success, the array must be two-dimensional, C-ordered, little-endian and of type @b _AniMeshScalar
+	*/
+	bool open(const std::string& fileName) {
+		file.close();
+		file.clear();
+		file.open(fileName, std::ios::binary);
+		if (!file) return false;
+
+		char magic[8];
+		if (!file.read(magic, 8)||(std::string(magic, 6)!="\x93NUMPY")) return false;
+		unsigned char len[4]={0, 0, 0, 0};
+		int lenBytes=(magic[6]==1)?2:4;
+		if (!file.read((char*)len, lenBytes)) return false;
+		std::size_t headerLen=std::size_t(len[0])|(std::size_t(len[1])<<8)|(std::size_t(len[2])<<16)|(std::size_t(len[3])<<24);
+		std::string header(headerLen, ' ');
+		if (!file.read(&header[0], headerLen)) return false;
+		offset=std::streamoff(6+2+lenBytes+headerLen);
+
+		std::string descr=value(header, "descr");
+		std::string type=std::string("f")+std::to_string(sizeof(_AniMeshScalar));
+		if ((descr.size()!=3)||(descr.compare(1, 2, type)!=0)||((descr[0]!='<')&&(descr[0]!='|')&&(descr[0]!='='))) return false;
+		if (value(header, "fortran_order").compare(0, 5, "False")!=0) return false;
+
+		std::string shape=value(header, "shape");
+		char* end;
+		long rows=std::strtol(shape.c_str()+1, &end, 10);
+		if (*end!=',') return false;
+		long cols=std::strtol(end+1, &end, 10);
+		if ((*end!=')')||(rows%3!=0)||(rows<=0)||(cols<=0)) return false;
+		nF=int(rows/3);
+		nV=int(cols);
+		return true;
+	}
+
+	int nFrames() const { return nF; }
+	int nVertices() const { return nV; }
+
+	void read(int k0, int nk, _AniMeshScalar* data) {
+		std::streamoff frameBytes=std::streamoff(3)*nV*sizeof(_AniMeshScalar);
+		file.clear();
+		file.seekg(offset+frameBytes*k0);
+		if (!file.read((char*)data, frameBytes*nk)) throw std::runtime_error("NpyFrameFile: cannot read frames "+std::to_string(k0)+" to "+std::to_string(k0+nk-1));
+	}
+
+private:
+	int nF, nV;
+	//! Offset of the array data from the beginning of the file
+	std::streamoff offset;
+	std::ifstream file;
+
+	/** @return the value of @p key in the header dictionary, without quotes
+		@param header is the header string
+		@param key is the dictionary key
+	*/
+	static std::string value(const std::string& header, const std::string& key) {
+		std::size_t p=header.find("'"+key+"'");
+		if (p==std::string::npos) return "";
+		p=header.find(':', p);
+		if (p==std::string::npos) return "";
+		p=header.find_first_not_of(" ", p+1);
+		if (p==std::string::npos) return "";
+		std::size_t q=(header[p]=='(')?header.find(')', p)+1:(header[p]=='\'')?header.find('\'', p+1)+1:header.find_first_of(",}", p);
+		std::string val=header.substr(p, q-p);
+		val.erase(std::remove(val.begin(), val.end(), ' '), val.end());
+		if ((val.size()>=2)&&(val[0]=='\'')) val=val.substr(1, val.size()-2);
+		return val;
+	}
+};
+
+/** @class FrameStream FrameSource.h "DemBones/FrameSource.h"
+	@brief Iterate over a FrameSource by chunks of frames with double buffering
+	@details The chunks never cross subjects. The next chunk is read (and tiled) in a background thread while the caller processes the current one:
+	@code
+	for (FrameStream<float> fs(source, fStart, 64); fs.next(); ) process(fs.frames(), fs.frameStart());
+	@endcode
+	Only two chunks are held in memory, none if FrameSource::mapped() is available and no tiles are requested. Read errors of FrameSource::read() are rethrown by next().
+*/
+template<class _AniMeshScalar>
+class FrameStream {
+public:
+	using MatrixR=typename FrameTiles<_AniMeshScalar>::MatrixR;
+	using MapR=typename FrameTiles<_AniMeshScalar>::MapR;
+
+	/** Start reading the first chunk
+		@param source is the sequence
+		@param fStart is the start frame indices of the subjects, [@c size] = @p nS+1
+		@param chunkFrames is the maximum number of frames per chunk
+		@param tileFrames is the maximum number of frames per tile of tiles(), 0 = do not build the tiles
+	*/
+	FrameStream(FrameSource<_AniMeshScalar>& source, const Eigen::VectorXi& fStart, int chunkFrames, int tileFrames=0): src(source), direct(source.mapped()), nV(source.nVertices()), tileF(tileFrames), cur(-1) {
+		chunkFrames=std::max(chunkFrames, 1);
+		for (int s=0; s+1<fStart.size(); s++)
+			for (int k=fStart(s); k<fStart(s+1); k+=chunkFrames) {
+				chunkStart.push_back(k);
+				chunkCount.push_back(std::min(chunkFrames, fStart(s+1)-k));
+			}
+		if (!chunkStart.empty()&&needLoad()) pending=std::async(std::launch::async, &FrameStream::load, this, 0);
+	}
+
+	FrameStream(const FrameStream&)=delete;
+	FrameStream& operator=(const FrameStream&)=delete;
+
+	~FrameStream() {
+		if (pending.valid()) pending.wait();
+	}
+
+	/** Move to the next chunk and start reading the following one
+		@return false if there is no more chunk
+	*/
+	bool next() {
+		if (pending.valid()) pending.get();
+		cur++;
+		if (cur>=(int)chunkStart.size()) return false;
+		if ((cur+1<(int)chunkStart.size())&&needLoad()) pending=std::async(std::launch::async, &FrameStream::load, this, cur+1);
+		return true;
+	}
+
+	//! @return first frame of the current chunk
+	int frameStart() const { return chunkStart[cur]; }
+	//! @return number of frames of the current chunk
+	int frameCount() const { return chunkCount[cur]; }
+	//! @return the row-major [3*frameCount(), @p nV] frames of the current chunk
+	MapR frames() const { return MapR(chunkData(cur), 3*frameCount(), nV); }
+	//! @return the tiles of the current chunk, with absolute frame indices
+	const FrameTiles<_AniMeshScalar>& tiles() const { return slot[cur%2].tiles; }
+
+private:
+	FrameSource<_AniMeshScalar>& src;
+	//! FrameSource::mapped() of the source
+	const _AniMeshScalar* direct;
+	int nV, tileF, cur;
+	std::vector<int> chunkStart, chunkCount;
+
+	struct Chunk {
+		std::vector<_AniMeshScalar> data;
+		FrameTiles<_AniMeshScalar> tiles;
+	} slot[2];
+
+	//! Read of the chunk after the current one
+	std::future<void> pending;
+
+	//! @return true if the chunks have to be read or tiled
+	bool needLoad() const { return (!direct)||(tileF>0); }
+
+	//! @return the frames of chunk @p c
+	const _AniMeshScalar* chunkData(int c) const {
+		return direct?direct+std::size_t(3*chunkStart[c])*nV:slot[c%2].data.data();
+	}
+
+	//! Read and/or tile chunk @p c into its slot
+	void load(int c) {
+		Chunk& ch=slot[c%2];
+		int k0=chunkStart[c], nk=chunkCount[c];
+		if (!direct) {
+			ch.data.resize(std::size_t(3*nk)*nV);
+			src.read(k0, nk, ch.data.data());
+		}
+		if (tileF>0) {
+			Eigen::VectorXi fs(2);
+			fs<<k0, k0+nk;
+			ch.tiles.build(MapR(chunkData(c), 3*nk, nV), fs, tileF, 1024, false);
+		}
+	}
+};
+
+}
+
+#endif
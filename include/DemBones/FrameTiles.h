@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+//               Dem Bones - Skinning Decomposition Library                  //
+//         Copyright (c) 2019, Electronic Arts. All rights reserved.         //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#ifndef DEM_BONES_FRAME_TILES
+#define DEM_BONES_FRAME_TILES
+
+#include <Eigen/Dense>
+#include <vector>
+#include <algorithm>
+
+namespace Dem
+{
+
+/** @class FrameTiles FrameTiles.h "DemBones/FrameTiles.h"
+	@brief Tiled copy of an animated mesh sequence for kernels looping over frames then vertices
+	@details The sequence @p v, [@c size] = [3*@p nF, @p nV], stores the frames of one vertex contiguously. A tile holds a block of frames of
+	a block of vertices as a row-major [3*frameCount(), vertexCount()] matrix: row 3*@p kk+@p d is the coordinate @p d of frame frameStart()+@p kk,
+	so the x, y, z coordinates of consecutive vertices are contiguous (structure of arrays). Frame blocks never cross subjects.
+	Frame indices are absolute, the tiles may cover a chunk of the sequence streamed by FrameStream.
+
+	@b _AniMeshScalar is the floating-point data type of the sequence.
+*/
+template<class _AniMeshScalar>
+class FrameTiles {
+public:
+	using MatrixR=Eigen::Matrix<_AniMeshScalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+	using MapR=Eigen::Map<const MatrixR>;
+
+	FrameTiles(): nV(0), nVBlk(0), tileV(0), tileF(0) {}
+
+	/** Build the tiles
+		@param[in] v is the sequence, [@c size] = [3*@p nF, @p nV], or a part of it where the row 0 is the frame @p fStart(0)
+		@param[in] fStart is the start frame indices of the subjects, [@c size] = @p nS+1
+		@param[in] nFrames is the maximum number of frames per tile
+		@param[in] nVerts is the maximum number of vertices per tile
+		@param[in] par=false will copy the tiles in the calling thread only
+	*/
+	template<class Derived>
+	void build(const Eigen::MatrixBase<Derived>& v, const Eigen::VectorXi& fStart, int nFrames=16, int nVerts=1024, bool par=true) {
+		nV=int(v.cols());
+		tileV=nVerts;
+		tileF=nFrames;
+		nVBlk=(nV+tileV-1)/tileV;
+		subjectStart=fStart;
+
+		std::vector<int> fb;
+		for (int s=0; s+1<fStart.size(); s++)
+			for (int k=fStart(s); k<fStart(s+1); k+=nFrames) fb.push_back(k);
+		fb.push_back(fStart.size()?fStart(fStart.size()-1):0);
+		frameBlk=Eigen::Map<Eigen::VectorXi>(fb.data(), fb.size());
+
+		int nFBlk=int(frameBlk.size())-1;
+		offset.resize(nFBlk*nVBlk+1);
+		offset[0]=0;
+		for (int b=0; b<nFBlk; b++)
+			for (int c=0; c<nVBlk; c++) offset[b*nVBlk+c+1]=offset[b*nVBlk+c]+std::size_t(3*frameCount(b))*vertexCount(c);
+		data.resize(offset[nFBlk*nVBlk]);
+
+		#pragma omp parallel for if(par)
+		for (int t=0; t<nFBlk*nVBlk; t++) {
+			int b=t/nVBlk, c=t%nVBlk;
+			Eigen::Map<MatrixR>(data.data()+offset[t], 3*frameCount(b), vertexCount(c))=v.block(3*(frameStart(b)-frameBlk(0)), vertexStart(c), 3*frameCount(b), vertexCount(c));
+		}
+	}
+
+	/** @return true if the tiles were built from a sequence with these dimensions and the same number of frames per tile
+		@param[in] v is the sequence
+		@param[in] fStart is the start frame indices of the subjects
+		@param[in] nFrames is the maximum number of frames per tile
+	*/
+	template<class Derived>
+	bool matches(const Eigen::MatrixBase<Derived>& v, const Eigen::VectorXi& fStart, int nFrames=16) const {
+		return (nV==v.cols())&&(tileF==nFrames)&&(subjectStart.size()==fStart.size())&&(subjectStart==fStart)&&
+			(frameBlk.size()>0)&&((frameBlk(frameBlk.size()-1)-frameBlk(0))*3==v.rows());
+	}
+
+	//! Free the memory
+	void clear() {
+		nV=nVBlk=tileV=tileF=0;
+		frameBlk.resize(0);
+		subjectStart.resize(0);
+		offset.clear();
+		data.clear();
+		data.shrink_to_fit();
+	}
+
+	//! @return number of frame blocks
+	int nFrameBlocks() const { return std::max(int(frameBlk.size())-1, 0); }
+	//! @return number of vertex blocks
+	int nVertexBlocks() const { return nVBlk; }
+	//! @return first frame of frame block @p b
+	int frameStart(int b) const { return frameBlk(b); }
+	//! @return number of frames of frame block @p b
+	int frameCount(int b) const { return frameBlk(b+1)-frameBlk(b); }
+	//! @return first vertex of vertex block @p c
+	int vertexStart(int c) const { return c*tileV; }
+	//! @return number of vertices of vertex block @p c
+	int vertexCount(int c) const { return std::min(tileV, nV-c*tileV); }
+	//! @return vertex block of vertex @p i
+	int vertexBlock(int i) const { return i/tileV; }
+
+	/** Tile
+		@param[in] b is the frame block index
+		@param[in] c is the vertex block index
+		@return the row-major [3*frameCount(@p b), vertexCount(@p c)] tile
+	*/
+	MapR tile(int b, int c) const {
+		return MapR(data.data()+offset[b*nVBlk+c], 3*frameCount(b), vertexCount(c));
+	}
+
+private:
+	int nV, nVBlk, tileV, tileF;
+	Eigen::VectorXi frameBlk, subjectStart;
+	std::vector<std::size_t> offset;
+	std::vector<_AniMeshScalar> data;
+};
+
+}
+
+#endif
@@ -0,0 +1,242 @@
+///////////////////////////////////////////////////////////////////////////////
+//               Dem Bones - Skinning Decomposition Library                  //
+//         Copyright (c) 2019, Electronic Arts. All rights reserved.         //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#ifndef DEM_BONES_RIGID_FIT
+#define DEM_BONES_RIGID_FIT
+
+#include <Eigen/Dense>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace Dem
+{
+
+/** @class RigidFit RigidFit.h "DemBones/RigidFit.h"
+	@brief Batched best rigid transformations from 4*4 covariance matrices
+	@details For each block, the covariance matrix @f$ qpT = \sum_i w_i \tilde{v}_i \tilde{u}_i^T @f$ is normalized by @f$ qpT(3, 3) @f$ and the rotation
+	maximizing @f$ tr(R^T C) @f$, @f$ C = qpT_{3 \times 3}-\bar{v}\bar{u}^T @f$, is found by Horn's quaternion method: the largest eigenvalue of the
+	symmetric 4*4 matrix @f$ N(C) @f$ is the largest root of its characteristic polynomial, which is found by Newton iterations from an upper bound,
+	and the eigenvector is taken from the adjugate of @f$ N-\lambda I @f$.
+	The optimal proper rotation is the same as @f$ U diag(1, 1, det(UV^T)) V^T @f$ from the SVD @f$ C=USV^T @f$.
+	Blocks are stored as structure of arrays so that the kernels are vectorized across blocks.
+	Degenerate blocks (repeated largest eigenvalue) fall back to the SVD.
+
+	@b _Scalar is the floating-point data type.
+*/
+template<class _Scalar>
+class RigidFit {
+public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	using MatrixX=Eigen::Matrix<_Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+	using VectorX=Eigen::Matrix<_Scalar, Eigen::Dynamic, 1>;
+	using Matrix4=Eigen::Matrix<_Scalar, 4, 4>;
+	using Matrix3=Eigen::Matrix<_Scalar, 3, 3>;
+	using Vector3=Eigen::Matrix<_Scalar, 3, 1>;
+
+	//! Maximum number of Newton iterations for the largest eigenvalue
+	int maxIters;
+
+	/** Constructor
+		@param[in] n is the number of blocks
+	*/
+	RigidFit(int n=0): maxIters(50) {
+		resize(n);
+	}
+
+	/** Set the number of blocks
+		@param[in] n is the number of blocks
+	*/
+	void resize(int n) {
+		if (n!=(int)a.rows()) a.resize(n, nComp);
+		nBlk=n;
+	}
+
+	//! @return number of blocks
+	int size() const { return nBlk; }
+
+	/** Set covariance matrix of a block
+		@param[in] b is the block index
+		@param[in] qpT is the 4*4 covariance matrix
+	*/
+	template<class Derived>
+	void set(int b, const Eigen::MatrixBase<Derived>& qpT) {
+		using S=typename Derived::Scalar; //The centering cancels, it is done in the precision of qpT
+		S s=qpT(3, 3);
+		a(b, VALID)=(s!=0);
+		if (s==0) s=1;
+		Eigen::Matrix<S, 3, 1> t=qpT.template block<3, 1>(0, 3)/s, uc=qpT.template block<1, 3>(3, 0).transpose()/s;
+		for (int r=0; r<3; r++) {
+			a(b, TX+r)=_Scalar(t(r));
+			a(b, UX+r)=_Scalar(uc(r));
+		}
+		for (int r=0; r<3; r++)
+			for (int c=0; c<3; c++) a(b, C00+r+c*3)=_Scalar(qpT(r, c)/s-t(r)*uc(c));
+	}
+
+	/** Solve all blocks
+	*/
+	void solve() {
+		_Scalar* A=a.data();
+		int n=nBlk;
+		int ld=(int)a.rows();
+		const _Scalar* c00=A+C00*ld; const _Scalar* c10=A+(C00+1)*ld; const _Scalar* c20=A+(C00+2)*ld;
+		const _Scalar* c01=A+(C00+3)*ld; const _Scalar* c11=A+(C00+4)*ld; const _Scalar* c21=A+(C00+5)*ld;
+		const _Scalar* c02=A+(C00+6)*ld; const _Scalar* c12=A+(C00+7)*ld; const _Scalar* c22=A+(C00+8)*ld;
+		_Scalar* lambda=A+LAMBDA*ld; _Scalar* lo=A+LO*ld; _Scalar* p2=A+P2*ld; _Scalar* p1=A+P1*ld; _Scalar* p0=A+P0*ld;
+		_Scalar* n00=A+N00*ld; _Scalar* n01=A+(N00+1)*ld; _Scalar* n02=A+(N00+2)*ld; _Scalar* n03=A+(N00+3)*ld;
+		_Scalar* n11=A+(N00+4)*ld; _Scalar* n12=A+(N00+5)*ld; _Scalar* n13=A+(N00+6)*ld;
+		_Scalar* n22=A+(N00+7)*ld; _Scalar* n23=A+(N00+8)*ld; _Scalar* n33=A+(N00+9)*ld;
+
+		//Horn's matrix, S=C^T, and characteristic polynomial lambda^4+p2*lambda^2+p1*lambda+p0
+		#pragma omp simd
+		for (int b=0; b<n; b++) {
+			_Scalar sxx=c00[b], sxy=c10[b], sxz=c20[b];
+			_Scalar syx=c01[b], syy=c11[b], syz=c21[b];
+			_Scalar szx=c02[b], szy=c12[b], szz=c22[b];
+			n00[b]=sxx+syy+szz; n01[b]=syz-szy; n02[b]=szx-sxz; n03[b]=sxy-syx;
+			n11[b]=sxx-syy-szz; n12[b]=sxy+syx; n13[b]=szx+sxz;
+			n22[b]=-sxx+syy-szz; n23[b]=syz+szy;
+			n33[b]=-sxx-syy+szz;
+			_Scalar f2=sxx*sxx+sxy*sxy+sxz*sxz+syx*syx+syy*syy+syz*syz+szx*szx+szy*szy+szz*szz;
+			_Scalar detS=sxx*(syy*szz-syz*szy)-sxy*(syx*szz-syz*szx)+sxz*(syx*szy-syy*szx);
+			p2[b]=-2*f2;
+			p1[b]=-8*detS;
+			p0[b]=det4(n00[b], n01[b], n02[b], n03[b], n11[b], n12[b], n13[b], n22[b], n23[b], n33[b]);
+			lambda[b]=std::sqrt(3*f2);
+			lo[b]=std::max(std::max(n00[b], n11[b]), std::max(n22[b], n33[b]));
+		}
+
+		//Newton iterations from the upper bound sqrt(3)*|S| >= largest eigenvalue, they decrease monotonically, rounding near a double root
+		//could overshoot and is bounded by the largest diagonal entry of N <= largest eigenvalue
+		_Scalar tol=Eigen::NumTraits<_Scalar>::epsilon()*8;
+		for (int iter=0; iter<maxIters; iter++) {
+			_Scalar maxStep=0;
+			#pragma omp simd reduction(max:maxStep)
+			for (int b=0; b<n; b++) {
+				_Scalar l=lambda[b];
+				_Scalar l2=l*l;
+				_Scalar f=(l2+p2[b])*l2+p1[b]*l+p0[b];
+				_Scalar df=(4*l2+2*p2[b])*l+p1[b];
+				_Scalar step=(df>0)?f/df:_Scalar(0);
+				lambda[b]=std::max(l-step, lo[b]);
+				_Scalar rel=std::abs(step)/(std::sqrt(-p2[b])+std::numeric_limits<_Scalar>::min());
+				maxStep=std::max(maxStep, rel);
+			}
+			if (maxStep<=tol) break;
+		}
+
+		//Eigenvector from the column of adj(N-lambda*I) with the largest diagonal
+		_Scalar* qw=A+QW*ld; _Scalar* qx=A+(QW+1)*ld; _Scalar* qy=A+(QW+2)*ld; _Scalar* qz=A+(QW+3)*ld;
+		_Scalar* degenerate=A+DEGENERATE*ld;
+		//A double root of the polynomial is only found to sqrt(epsilon), so blocks with a small spectral gap use the SVD. In single precision the rounding
+		//of the determinant p0 dominates, e.g. rank-1 covariances of 2 vertices, so the threshold is scaled up
+		_Scalar dtol=std::sqrt(std::sqrt(Eigen::NumTraits<_Scalar>::epsilon()))*((std::numeric_limits<_Scalar>::digits<std::numeric_limits<double>::digits)?_Scalar(16):_Scalar(1));
+		#pragma omp simd
+		for (int b=0; b<n; b++) {
+			_Scalar l=lambda[b];
+			_Scalar m00=n00[b]-l, m01=n01[b], m02=n02[b], m03=n03[b];
+			_Scalar m11=n11[b]-l, m12=n12[b], m13=n13[b];
+			_Scalar m22=n22[b]-l, m23=n23[b];
+			_Scalar m33=n33[b]-l;
+			//Cofactors, adj(M)(r, c)=cofactor(c, r), symmetric
+			_Scalar a00=det3(m11, m12, m13, m12, m22, m23, m13, m23, m33);
+			_Scalar a11=det3(m00, m02, m03, m02, m22, m23, m03, m23, m33);
+			_Scalar a22=det3(m00, m01, m03, m01, m11, m13, m03, m13, m33);
+			_Scalar a33=det3(m00, m01, m02, m01, m11, m12, m02, m12, m22);
+			_Scalar a01=-det3(m01, m02, m03, m12, m22, m23, m13, m23, m33);
+			_Scalar a02=det3(m01, m02, m03, m11, m12, m13, m13, m23, m33);
+			_Scalar a03=-det3(m01, m02, m03, m11, m12, m13, m12, m22, m23);
+			_Scalar a12=-det3(m00, m02, m03, m01, m12, m13, m03, m23, m33);
+			_Scalar a13=det3(m00, m02, m03, m01, m12, m13, m02, m22, m23);
+			_Scalar a23=-det3(m00, m01, m03, m01, m11, m13, m02, m12, m23);
+
+			_Scalar e0=a00, e1=a01, e2=a02, e3=a03, d=a00;
+			bool c1=std::abs(a11)>std::abs(d);
+			e0=c1?a01:e0; e1=c1?a11:e1; e2=c1?a12:e2; e3=c1?a13:e3; d=c1?a11:d;
+			bool c2=std::abs(a22)>std::abs(d);
+			e0=c2?a02:e0; e1=c2?a12:e1; e2=c2?a22:e2; e3=c2?a23:e3; d=c2?a22:d;
+			bool c3=std::abs(a33)>std::abs(d);
+			e0=c3?a03:e0; e1=c3?a13:e1; e2=c3?a23:e2; e3=c3?a33:e3; d=c3?a33:d;
+
+			_Scalar qn=std::sqrt(e0*e0+e1*e1+e2*e2+e3*e3);
+			_Scalar scale=std::sqrt(-p2[b]);
+			degenerate[b]=!(std::abs(d)>dtol*scale*scale*scale);
+			_Scalar inv=(qn>0)?1/qn:_Scalar(0);
+			qw[b]=e0*inv; qx[b]=e1*inv; qy[b]=e2*inv; qz[b]=e3*inv;
+		}
+
+		//Rotations from quaternions
+		_Scalar* r[9];
+		for (int c=0; c<9; c++) r[c]=A+(R00+c)*ld;
+		#pragma omp simd
+		for (int b=0; b<n; b++) {
+			_Scalar w=qw[b], x=qx[b], y=qy[b], z=qz[b];
+			r[0][b]=w*w+x*x-y*y-z*z; r[3][b]=2*(x*y-w*z); r[6][b]=2*(x*z+w*y);
+			r[1][b]=2*(x*y+w*z); r[4][b]=w*w-x*x+y*y-z*z; r[7][b]=2*(y*z-w*x);
+			r[2][b]=2*(x*z-w*y); r[5][b]=2*(y*z+w*x); r[8][b]=w*w-x*x-y*y+z*z;
+		}
+
+		for (int b=0; b<n; b++)
+			if ((a(b, VALID)!=0)&&(a(b, DEGENERATE)!=0)) solveSVD(b);
+	}
+
+	//! @return true if the covariance matrix of block @p b has non-zero weight, i.e. qpT(3, 3)!=0
+	bool valid(int b) const { return a(b, VALID)!=0; }
+
+	//! @return rotation matrix of block @p b
+	Matrix3 rotation(int b) const {
+		Matrix3 rot;
+		for (int c=0; c<9; c++) rot(c%3, c/3)=a(b, R00+c);
+		return rot;
+	}
+
+	//! @return translation vector of block @p b
+	Vector3 translation(int b) const {
+		return Vector3(a(b, TX), a(b, TX+1), a(b, TX+2))-rotation(b)*Vector3(a(b, UX), a(b, UX+1), a(b, UX+2));
+	}
+
+private:
+	//! Columns of the structure of arrays #a
+	enum { VALID=0, TX=1, UX=4, C00=7, N00=16, P2=26, P1=27, P0=28, LAMBDA=29, QW=30, DEGENERATE=34, R00=35, LO=44, nComp=45 };
+
+	//! Structure of arrays, a.@a col(c)(b) is the component c of block b
+	MatrixX a;
+
+	//! Number of blocks
+	int nBlk;
+
+	//! Determinant of a 3*3 matrix given row by row
+	static _Scalar det3(_Scalar a00, _Scalar a01, _Scalar a02, _Scalar a10, _Scalar a11, _Scalar a12, _Scalar a20, _Scalar a21, _Scalar a22) {
+		return a00*(a11*a22-a12*a21)-a01*(a10*a22-a12*a20)+a02*(a10*a21-a11*a20);
+	}
+
+	//! Determinant of a symmetric 4*4 matrix given by its upper triangle
+	static _Scalar det4(_Scalar m00, _Scalar m01, _Scalar m02, _Scalar m03, _Scalar m11, _Scalar m12, _Scalar m13, _Scalar m22, _Scalar m23, _Scalar m33) {
+		return m00*det3(m11, m12, m13, m12, m22, m23, m13, m23, m33)
+			-m01*det3(m01, m12, m13, m02, m22, m23, m03, m23, m33)
+			+m02*det3(m01, m11, m13, m02, m12, m23, m03, m13, m33)
+			-m03*det3(m01, m11, m12, m02, m12, m22, m03, m13, m23);
+	}
+
+	/** SVD fallback for degenerate blocks, same as the reflection handling d(2, 2)=det(UV^T)
+		@param b is the block index
+	*/
+	void solveSVD(int b) {
+		Matrix3 c;
+		for (int i=0; i<9; i++) c(i%3, i/3)=a(b, C00+i);
+		Eigen::JacobiSVD<Matrix3> svd(c, Eigen::ComputeFullU|Eigen::ComputeFullV);
+		Matrix3 d=Matrix3::Identity();
+		d(2, 2)=(svd.matrixU()*svd.matrixV().transpose()).determinant();
+		Matrix3 rot=svd.matrixU()*d*svd.matrixV().transpose();
+		for (int i=0; i<9; i++) a(b, R00+i)=rot(i%3, i/3);
+	}
+};
+
+}
+
+#endif
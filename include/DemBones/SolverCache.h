@@ -0,0 +1,175 @@
+///////////////////////////////////////////////////////////////////////////////
+//               Dem Bones - Skinning Decomposition Library                  //
+//         Copyright (c) 2019, Electronic Arts. All rights reserved.         //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#ifndef DEM_BONES_SOLVER_CACHE
+#define DEM_BONES_SOLVER_CACHE
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+namespace Dem
+{
+
+/** @class Hash64 SolverCache.h "DemBones/SolverCache.h"
+	@brief 64-bit hash of binary data, used as the key of cached solvers, it is not a cryptographic hash
+*/
+class Hash64 {
+public:
+	Hash64(std::uint64_t seed=0): h(seed^0xcbf29ce484222325ull) {}
+
+	//! Hash @p n bytes at @p data
+	Hash64& add(const void* data, std::size_t n) {
+		const unsigned char* p=(const unsigned char*)data;
+		for (; n>=8; n-=8, p+=8) {
+			std::uint64_t x;
+			std::memcpy(&x, p, 8);
+			mix(x);
+		}
+		if (n>0) {
+			std::uint64_t x=0;
+			std::memcpy(&x, p, n);
+			mix(x^(std::uint64_t(n)<<56));
+		}
+		return *this;
+	}
+
+	//! Hash a value of trivially copyable type @p T
+	template<class T>
+	Hash64& add(const T& x) {
+		return add(&x, sizeof(T));
+	}
+
+	//! Hash the size and the coefficients of a dense matrix
+	template<class Derived>
+	Hash64& addMatrix(const Eigen::PlainObjectBase<Derived>& a) {
+		add(std::int64_t(a.rows()));
+		add(std::int64_t(a.cols()));
+		return add(a.data(), sizeof(typename Derived::Scalar)*a.size());
+	}
+
+	//! @return the hash value
+	std::uint64_t value() const {
+		std::uint64_t z=h;
+		z=(z^(z>>30))*0xbf58476d1ce4e5b9ull;
+		z=(z^(z>>27))*0x94d049bb133111ebull;
+		return z^(z>>31);
+	}
+
+private:
+	std::uint64_t h;
+
+	void mix(std::uint64_t x) {
+		h=(h^x)*0x100000001b3ull;
+		h^=h>>29;
+	}
+};
+
+/** Write a dense matrix in binary
+	@param out is the stream
+	@param a is the matrix
+*/
+template<class Derived>
+void writeBinary(std::ostream& out, const Eigen::PlainObjectBase<Derived>& a) {
+	std::int64_t dim[2]={std::int64_t(a.rows()), std::int64_t(a.cols())};
+	out.write((const char*)dim, sizeof(dim));
+	out.write((const char*)a.data(), sizeof(typename Derived::Scalar)*a.size());
+}
+
+/** Read a dense matrix written by writeBinary()
+	@param in is the stream
+	@param a is the by-reference output
+	@return true if success
+*/
+template<class Derived>
+bool readBinary(std::istream& in, Eigen::PlainObjectBase<Derived>& a) {
+	std::int64_t dim[2];
+	if (!in.read((char*)dim, sizeof(dim))||(dim[0]<0)||(dim[1]<0)) return false;
+	if (((Derived::RowsAtCompileTime!=Eigen::Dynamic)&&(dim[0]!=Derived::RowsAtCompileTime))||
+		((Derived::ColsAtCompileTime!=Eigen::Dynamic)&&(dim[1]!=Derived::ColsAtCompileTime))) return false;
+	a.resize(dim[0], dim[1]);
+	return (bool)in.read((char*)a.data(), sizeof(typename Derived::Scalar)*a.size());
+}
+
+/** Write a compressed sparse matrix in binary
+	@param out is the stream
+	@param a is the compressed matrix
+*/
+template<class _Scalar, int _Options, class _StorageIndex>
+void writeBinary(std::ostream& out, const Eigen::SparseMatrix<_Scalar, _Options, _StorageIndex>& a) {
+	std::int64_t dim[3]={std::int64_t(a.rows()), std::int64_t(a.cols()), std::int64_t(a.nonZeros())};
+	out.write((const char*)dim, sizeof(dim));
+	out.write((const char*)a.outerIndexPtr(), sizeof(_StorageIndex)*(a.outerSize()+1));
+	out.write((const char*)a.innerIndexPtr(), sizeof(_StorageIndex)*a.nonZeros());
+	out.write((const char*)a.valuePtr(), sizeof(_Scalar)*a.nonZeros());
+}
+
+/** Read a compressed sparse matrix written by writeBinary()
+	@param in is the stream
+	@param a is the by-reference output
+	@return true if success
+*/
+template<class _Scalar, int _Options, class _StorageIndex>
+bool readBinary(std::istream& in, Eigen::SparseMatrix<_Scalar, _Options, _StorageIndex>& a) {
+	std::int64_t dim[3];
+	if (!in.read((char*)dim, sizeof(dim))||(dim[0]<0)||(dim[1]<0)||(dim[2]<0)) return false;
+	a.resize(dim[0], dim[1]);
+	a.resizeNonZeros(dim[2]);
+	return in.read((char*)a.outerIndexPtr(), sizeof(_StorageIndex)*(a.outerSize()+1))&&
+		in.read((char*)a.innerIndexPtr(), sizeof(_StorageIndex)*dim[2])&&
+		in.read((char*)a.valuePtr(), sizeof(_Scalar)*dim[2])&&
+		(a.outerIndexPtr()[a.outerSize()]==dim[2]);
+}
+
+/** @class CachedLDLT SolverCache.h "DemBones/SolverCache.h"
+	@brief Eigen::SimplicialLDLT whose symbolic and numeric factorization can be saved and loaded in binary
+	@details The stored data are the fill-reducing permutation, the elimination tree and the factors L and D, so a loaded solver solves
+	without analyzePattern() nor factorize(). The format depends on the scalar and index types.
+*/
+template<class _MatrixType>
+class CachedLDLT: public Eigen::SimplicialLDLT<_MatrixType> {
+	using Base=Eigen::SimplicialLDLT<_MatrixType>;
+public:
+	/** Write the factorization
+		@param out is the stream
+		@return false if the solver is not factorized
+	*/
+	bool save(std::ostream& out) const {
+		if (!this->m_factorizationIsOk||(this->m_info!=Eigen::Success)) return false;
+		writeBinary(out, this->m_matrix);
+		writeBinary(out, this->m_diag);
+		writeBinary(out, this->m_parent);
+		writeBinary(out, this->m_nonZerosPerCol);
+		writeBinary(out, this->m_P.indices());
+		writeBinary(out, this->m_Pinv.indices());
+		out.write((const char*)&this->m_shiftOffset, sizeof(this->m_shiftOffset));
+		out.write((const char*)&this->m_shiftScale, sizeof(this->m_shiftScale));
+		return (bool)out;
+	}
+
+	/** Read a factorization written by save()
+		@param in is the stream
+		@return true if success, then the solver is ready to solve
+	*/
+	bool load(std::istream& in) {
+		bool ok=readBinary(in, this->m_matrix)&&readBinary(in, this->m_diag)&&readBinary(in, this->m_parent)&&readBinary(in, this->m_nonZerosPerCol)&&
+			readBinary(in, this->m_P.indices())&&readBinary(in, this->m_Pinv.indices())&&
+			in.read((char*)&this->m_shiftOffset, sizeof(this->m_shiftOffset))&&in.read((char*)&this->m_shiftScale, sizeof(this->m_shiftScale));
+		Eigen::Index n=this->m_matrix.rows();
+		ok=ok&&(this->m_matrix.cols()==n)&&(this->m_diag.size()==n)&&(this->m_P.size()==n)&&(this->m_Pinv.size()==n);
+		this->m_info=ok?Eigen::Success:Eigen::InvalidInput;
+		this->m_analysisIsOk=this->m_factorizationIsOk=ok;
+		this->Eigen::template SparseSolverBase<Base>::m_isInitialized=ok;
+		return ok;
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+//               Dem Bones - Skinning Decomposition Library                  //
+//         Copyright (c) 2019, Electronic Arts. All rights reserved.         //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#ifndef DEM_BONES_WORKSPACE
+#define DEM_BONES_WORKSPACE
+
+#include <Eigen/Dense>
+#include <vector>
+
+namespace Dem
+{
+
+/** @class Workspace Workspace.h "DemBones/Workspace.h"
+	@brief Scratch buffers reused across calls to avoid heap allocations in inner loops
+	@details Buffers are addressed by slot numbers chosen by the callers (see ConvexLS::WS_END) and returned as Eigen maps.
+	A buffer only grows, so once it has reached the largest requested size further requests do not allocate.
+	Each growth is counted in #nAllocs. A workspace is not thread-safe, use one per thread.
+
+	@b _Scalar is the floating-point data type.
+*/
+template<class _Scalar>
+class Workspace {
+public:
+	using MapX=Eigen::Map<Eigen::Matrix<_Scalar, Eigen::Dynamic, Eigen::Dynamic>>;
+	using MapV=Eigen::Map<Eigen::Matrix<_Scalar, Eigen::Dynamic, 1>>;
+	using MapI=Eigen::Map<Eigen::VectorXi>;
+
+	//! Number of heap allocations made by the workspace since construction, and by the solvers using it outside of it, see ConvexLS
+	long long nAllocs;
+
+	Workspace(): nAllocs(0) {}
+
+	/** Matrix buffer
+		@param[in] slot is the slot number
+		@param[in] rows, cols are the matrix dimensions
+	*/
+	MapX matrix(int slot, int rows, int cols) {
+		return MapX(grow(val, slot, rows*cols), rows, cols);
+	}
+
+	/** Vector buffer
+		@param[in] slot is the slot number
+		@param[in] n is the vector size
+	*/
+	MapV vector(int slot, int n) {
+		return MapV(grow(val, slot, n), n);
+	}
+
+	/** Index buffer, index slots are separated from matrix and vector slots
+		@param[in] slot is the slot number
+		@param[in] n is the vector size
+	*/
+	MapI indices(int slot, int n) {
+		return MapI(grow(idx, slot, n), n);
+	}
+
+private:
+	std::vector<std::vector<_Scalar>> val;
+	std::vector<std::vector<int>> idx;
+
+	template<class T>
+	T* grow(std::vector<std::vector<T>>& buf, int slot, int n) {
+		if (slot>=(int)buf.size()) {
+			buf.resize(slot+1);
+			nAllocs++;
+		}
+		if ((int)buf[slot].size()<n) {
+			buf[slot].resize(n);
+			nAllocs++;
+		}
+		return buf[slot].data();
+	}
+};
+
+}
+
+#endif
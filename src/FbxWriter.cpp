@@ -223,7 +223,8 @@ public:
 	}
 };
 
-bool writeFBXs(string fileName,  DemBonesExt<double, float>& model, bool embedMedia) {
+template<class _Scalar>
+bool writeFBXs(string fileName,  DemBonesExt<_Scalar, float>& model, bool embedMedia) {
 	msg(1, "Writing outputs:\n");
 
 	FbxSceneExporter exporter(embedMedia);
@@ -239,18 +240,19 @@ bool writeFBXs(string fileName,  DemBonesExt<double, float>& model, bool embedMe
 			s<<"joint"<<j;
 			model.boneName[j]=s.str();
 		}
-		radius=sqrt((model.u-(model.u.rowwise().sum()/model.nV).replicate(1, model.nV)).cwiseAbs().rowwise().maxCoeff().squaredNorm()/model.nS);
+		radius=sqrt((model.u-(model.u.rowwise().sum()/model.nV).replicate(1, model.nV)).cwiseAbs().rowwise().maxCoeff().template cast<double>().squaredNorm()/model.nS);
 	}
 	for (int s=0; s<model.nS; s++) {
 		msg(1, "Loaded complete mesh:" << s << "\n");
 
 		msg(1, "--> \""<<fileName<<"\" ");
 		// Write Mesh
-		exporter.createMesh(model.u,model.fv);
+		exporter.createMesh(model.u.template cast<double>(),model.fv);
 
-		MatrixXd lr, lt, gb, lbr, lbt;
+		typename DemBonesExt<_Scalar, float>::MatrixX _lr, _lt, _gb, _lbr, _lbt;
 
-		model.computeRTB(s, lr, lt, gb, lbr, lbt);
+		model.computeRTB(s, _lr, _lt, _gb, _lbr, _lbt);
+		MatrixXd lr=_lr.template cast<double>(), lt=_lt.template cast<double>(), gb=_gb.template cast<double>(), lbr=_lbr.template cast<double>(), lbt=_lbt.template cast<double>();
 
 		if (needCreateJoints) exporter.createJoints(model.boneName, model.parent, radius);
 		msg(1, "Bonename:" << model.boneName.size() << "\n");
@@ -263,7 +265,7 @@ bool writeFBXs(string fileName,  DemBonesExt<double, float>& model, bool embedMe
 		msg(1, "W:" << model.w.size() << "\n");
 
 
-		exporter.setSkinCluster(model.boneName, model.w, gb);
+		exporter.setSkinCluster(model.boneName, model.w.template cast<double>(), gb);
 
 		msg(1, "Loaded complete mesh\n");
 
@@ -276,3 +278,6 @@ bool writeFBXs(string fileName,  DemBonesExt<double, float>& model, bool embedMe
 
 	return true;
 }
+
+template bool writeFBXs<double>(string fileName, DemBonesExt<double, float>& model, bool embedMedia);
+template bool writeFBXs<float>(string fileName, DemBonesExt<float, float>& model, bool embedMedia);
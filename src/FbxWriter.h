@@ -18,4 +18,5 @@ using namespace Dem;
 	@param inputFileNames is the list of original input files, which is used to initilize the scene to get others than skinCluster-related info
 	@return true if success
 */
-bool writeFBXs(string fileName, DemBonesExt<double, float>& model, bool embedMedia=true);
+template<class _Scalar>
+bool writeFBXs(string fileName, DemBonesExt<_Scalar, float>& model, bool embedMedia=true);
@@ -10,12 +10,28 @@ using namespace Eigen;
 
 #define err(msgStr) {msg(1, msgStr); return false;}
 
-bool readNumpy(MatrixXd vert_data,vector< vector<int> > face_data, DemBonesExt<double, float>& model){
+//! Sequence viewing a float32 numpy array of shape (3*nF, nV), the array is referenced by the source instead of copied
+class NumpyFrameSource: public BufferFrameSource<float> {
+public:
+	NumpyFrameSource(pybind11::array a): BufferFrameSource<float>((const float*)a.data(), int(a.shape(0)/3), int(a.shape(1)), (a.flags()&pybind11::array::c_style)!=0), array(a) {}
+
+private:
+	pybind11::array array;
+};
+
+template<class _Scalar>
+bool readNumpy(pybind11::array_t<float, pybind11::array::forcecast> vert_data, const vector< vector<int> >& face_data, DemBonesExt<_Scalar, float>& model){
+	if ((vert_data.ndim()!=2)||(vert_data.shape(0)%3!=0)) err("Vertices must be an array of shape (3*nF, nV).\n");
+
+	// C- and F-contiguous float32 arrays are used in place, other dtypes are converted once by forcecast and other strides are copied once
+	pybind11::array buffer=vert_data;
+	if (!(vert_data.flags()&(pybind11::array::c_style|pybind11::array::f_style))) buffer=pybind11::array_t<float, pybind11::array::c_style|pybind11::array::forcecast>::ensure(vert_data);
+	auto src=make_shared<NumpyFrameSource>(buffer);
 	
 	// Using vertices define 3D parameters
 	model.nS = 1;
-	model.nF = vert_data.rows()/3;
-	model.nV = vert_data.cols();
+	model.nF = src->nFrames();
+	model.nV = src->nVertices();
 	model.fStart.resize(model.nS+1);
 	model.fStart(0)=0;
 	model.fStart(1) = model.nF;
@@ -25,23 +41,15 @@ bool readNumpy(MatrixXd vert_data,vector< vector<int> > face_data, DemBonesExt<d
 		for (int k=model.fStart(s); k<model.fStart(s+1); k++) model.subjectID(k)=s;
 
 	// Set model parameters
-	model.v.resize(3*model.nF,model.nV);
+	model.v.resize(0, 0);
+	model.frameSource=src;
 	model.fTime.resize(model.nF);
-	for(auto i=0;i<model.fTime.size();i++){
-		model.fTime[i] = 1/33;
-	}
-
-	model.v = vert_data.cast<float>();
-
-
-	MatrixXd wd(0, 0);
 
 	// Using first frame as u
 	msg(1, "Adding First timestep as rest pose.\n");
-	model.u.resize(model.nS*3, model.nV);
-	for(int i= 0;i<3;i++)
-		for(int k=0;k<model.nV;k++)
-			model.u(i,k) = vert_data(i,k);
+	Matrix<float, Dynamic, Dynamic, RowMajor> first(3, model.nV);
+	src->read(0, 1, first.data());
+	model.u=first.cast<_Scalar>();
 	msg(1, " Done!\n");
 
 	// Assign faces
@@ -59,4 +67,49 @@ bool readNumpy(MatrixXd vert_data,vector< vector<int> > face_data, DemBonesExt<d
 		model.fTime[i] = double(i);
 
 	return 1;
-}
\ No newline at end of file
+}
+
+vector< vector<int> > readNumpyFaces(pybind11::array_t<int, pybind11::array::c_style|pybind11::array::forcecast> face_data){
+	vector< vector<int> > fv;
+	if (face_data.ndim()!=2) return fv;
+	Map<const Matrix<int, Dynamic, Dynamic, RowMajor>> f(face_data.data(), face_data.shape(0), face_data.shape(1));
+	fv.resize(f.rows());
+	for (int p=0; p<(int)f.rows(); p++) fv[p].assign(f.row(p).data(), f.row(p).data()+f.cols());
+	return fv;
+}
+
+template<class _Scalar>
+bool readNumpyStream(string fileName, vector< vector<int> > face_data, DemBonesExt<_Scalar, float>& model){
+	auto src=make_shared<NpyFrameFile<float>>();
+	if (!src->open(fileName)) err("Unsupported or missing file (a C-ordered float32 array of shape (3*nF, nV) is expected): "<<fileName<<"\n");
+
+	model.nS = 1;
+	model.nF = src->nFrames();
+	model.nV = src->nVertices();
+	model.fStart.resize(model.nS+1);
+	model.fStart(0)=0;
+	model.fStart(1) = model.nF;
+	model.subjectID=VectorXi::Zero(model.nF);
+
+	// Frames are streamed from the file, only the first one is read as u
+	msg(1, "Adding First timestep as rest pose.\n");
+	Matrix<float, Dynamic, Dynamic, RowMajor> first(3, model.nV);
+	src->read(0, 1, first.data());
+	model.u=first.cast<_Scalar>();
+	model.v.resize(0, 0);
+	model.frameSource=src;
+	msg(1, " Done!\n");
+
+	model.fv = face_data;
+
+	model.fTime.resize(model.nF);
+	for(auto i=0;i<model.fTime.size();i++)
+		model.fTime[i] = double(i);
+
+	return 1;
+}
+
+template bool readNumpy<double>(pybind11::array_t<float, pybind11::array::forcecast> vert_data, const vector< vector<int> >& face_data, DemBonesExt<double, float>& model);
+template bool readNumpy<float>(pybind11::array_t<float, pybind11::array::forcecast> vert_data, const vector< vector<int> >& face_data, DemBonesExt<float, float>& model);
+template bool readNumpyStream<double>(string fileName,vector< vector<int> > face_data, DemBonesExt<double, float>& model);
+template bool readNumpyStream<float>(string fileName,vector< vector<int> > face_data, DemBonesExt<float, float>& model);
@@ -19,8 +19,21 @@
 using namespace std;
 using namespace Dem;
 
-/** Read FBX files and set: model.u, model.fv, model.w (if exist), model.m (if exist), model.nB,
-	model.boneName (if exist), model.parent (if exist), model.bind (if exist), model.preMulInv (if exist), model.rotOrder (if exist), model.orient (if exist)
+/** Set the sequence from a numpy array of shape (3*nF, nV) and set: model.u (first frame), model.fv, model.nF, model.nV, model.nS, model.fStart,
+	model.subjectID, model.fTime. C- and F-contiguous arrays are not copied, model.frameSource keeps a reference to them.
 	@return true if success
 */
-bool readNumpy(Eigen::MatrixXd vert_data,vector< vector<int> > face_data, DemBonesExt<double, float>& model);
+template<class _Scalar>
+bool readNumpy(pybind11::array_t<float, pybind11::array::forcecast> vert_data, const vector< vector<int> >& face_data, DemBonesExt<_Scalar, float>& model);
+
+/** Polygons from an int32 numpy array of shape (nP, k)
+	@return the list of polygons, empty if the array is not two-dimensional
+*/
+vector< vector<int> > readNumpyFaces(pybind11::array_t<int, pybind11::array::c_style|pybind11::array::forcecast> face_data);
+
+/** Open a .npy file holding a C-ordered float32 array of shape (3*nF, nV), the layout of @p vert_data in readNumpy(), as the out-of-core sequence
+	model.frameSource and set: model.u (first frame), model.fv, model.nF, model.nV, model.nS, model.fStart, model.subjectID, model.fTime
+	@return true if success
+*/
+template<class _Scalar>
+bool readNumpyStream(string fileName, vector< vector<int> > face_data, DemBonesExt<_Scalar, float>& model);
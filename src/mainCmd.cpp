@@ -5,10 +5,15 @@
 
 #include <DemBones/DemBonesExt.h>
 #include <DemBones/MatBlocks.h>
+#include <DemBones/BatchScheduler.h>
 #include "NumpyReader.h"
 #include "FbxReader.h"
 #include "FbxWriter.h"
 #include "LogMsg.h"
+#include <map>
+#include <atomic>
+#include <future>
+#include <functional>
 
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
@@ -19,18 +24,121 @@ using namespace std;
 using namespace Eigen;
 using namespace Dem;
 
-class MyDemBones: public DemBonesExt<double, float> { // _Scalar = double, _AnimeshScalar = float 
+/** @class AsyncRun
+	@brief Handle of a solve running in a background thread without the GIL, returned by run_ssdr_async()
+	@details The methods and attribute setters of the solver raise RuntimeError until done() returns true.
+*/
+class AsyncRun {
 public:
+	/** Constructor
+		@param f is the running solve, its value is false if the output file cannot be written
+		@param stop is the cancellation flag polled by the solver callbacks
+		@param results builds the results from the solver, called with the GIL
+	*/
+	AsyncRun(std::future<bool>&& f, std::atomic<bool>& stop, std::function<pybind11::tuple()> results): solve(f.share()), stop(stop), results(results) {}
+
+	~AsyncRun() {
+		pybind11::gil_scoped_release release;
+		if (solve.valid()) solve.wait();
+	}
+
+	//! @return true if the solve has finished, was cancelled or failed
+	bool done() const {
+		return solve.wait_for(std::chrono::seconds(0))==std::future_status::ready;
+	}
+
+	//! Request the solver to stop at the end of the current iteration, the results so far are still returned by result()
+	void cancel() {
+		stop=true;
+	}
+
+	//! @return true if cancel() was called
+	bool cancelled() const {
+		return stop;
+	}
+
+	//! Wait for the solve and return (w, m, rmse) like run_ssdr(), rethrow the error of the solve
+	pybind11::tuple result() {
+		{
+			pybind11::gil_scoped_release release;
+			solve.wait();
+		}
+		return solve.get()?results():pybind11::make_tuple();
+	}
+
+private:
+	std::shared_future<bool> solve;
+	std::atomic<bool>& stop;
+	std::function<pybind11::tuple()> results;
+};
+
+template<class _Scalar>
+class MyDemBonesT: public DemBonesExt<_Scalar, float> { // _AnimeshScalar = float 
+public:
+	using MatrixX=typename DemBonesExt<_Scalar, float>::MatrixX;
+	using SparseMatrix=typename DemBonesExt<_Scalar, float>::SparseMatrix;
+	using DemBonesExt<_Scalar, float>::nIters;
+	using DemBonesExt<_Scalar, float>::multiLevels;
+	using DemBonesExt<_Scalar, float>::levelIters;
+	using DemBonesExt<_Scalar, float>::repFrames;
+	using DemBonesExt<_Scalar, float>::nInitIters;
+	using DemBonesExt<_Scalar, float>::nTransIters;
+	using DemBonesExt<_Scalar, float>::transAffine;
+	using DemBonesExt<_Scalar, float>::transAffineNorm;
+	using DemBonesExt<_Scalar, float>::nWeightsIters;
+	using DemBonesExt<_Scalar, float>::nnz;
+	using DemBonesExt<_Scalar, float>::weightsSmooth;
+	using DemBonesExt<_Scalar, float>::weightsSmoothStep;
+	using DemBonesExt<_Scalar, float>::weightEps;
+	using DemBonesExt<_Scalar, float>::bindUpdate;
+	using DemBonesExt<_Scalar, float>::nB;
+	using DemBonesExt<_Scalar, float>::iter;
+	using DemBonesExt<_Scalar, float>::rmse;
+	using DemBonesExt<_Scalar, float>::clear;
+	using DemBonesExt<_Scalar, float>::init;
+	using DemBonesExt<_Scalar, float>::w;
+	using DemBonesExt<_Scalar, float>::m;
+
 	double tolerance;
 	int patience;
 	double rsme_err;
+	//! Accumulated wall-clock time (in seconds) per solver phase reported by cbTiming()
+	map<string, double> timings;
+	//! Cancellation request, the iteration callbacks stop the solver when it is set
+	std::atomic<bool> stop;
+	//! Set while a solve started by run_ssdr_async() runs, cleared before its AsyncRun is done()
+	std::atomic<bool> busy;
+
+	MyDemBonesT(): tolerance(1e-3), patience(3), rsme_err(0), stop(false), busy(false) { nIters=100; }
+
+	//! Raise RuntimeError in Python while a solve started by run_ssdr_async() runs
+	void checkIdle() const {
+		if (busy) throw std::runtime_error("The solver is running in the background, wait until done() of its run_ssdr_async() handle");
+	}
+
+	//! @return the member function @p f for the bindings, raising while a background solve runs, see checkIdle()
+	template<class R, class C, class... Args>
+	static std::function<R(MyDemBonesT&, Args...)> idle(R (C::*f)(Args...)) {
+		return [f](MyDemBonesT& d, Args... args) { d.checkIdle(); return (d.*f)(args...); };
+	}
+
+	//! @return getter of the attribute @p pm for the bindings
+	template<class C, class T>
+	static std::function<const T&(const MyDemBonesT&)> getter(T C::*pm) {
+		return [pm](const MyDemBonesT& d) -> const T& { return d.*pm; };
+	}
 
-	MyDemBones(): tolerance(1e-3), patience(3) { nIters=100; }
+	//! @return setter of the attribute @p pm for the bindings, raising while a background solve runs, see checkIdle()
+	template<class C, class T>
+	static std::function<void(MyDemBonesT&, const T&)> setter(T C::*pm) {
+		return [pm](MyDemBonesT& d, const T& x) { d.checkIdle(); d.*pm=x; };
+	}
 
 	void compute() {
 		prevErr=-1;
 		np=patience;
-		DemBonesExt<double, float>::compute();
+		DemBonesExt<_Scalar, float>::compute();
+		rsme_err=rmse(); // The last transformations update may follow the last cbIterEnd(), e.g. with repFrames
 	}
 
 	void cbIterBegin() {
@@ -39,6 +147,10 @@ public:
 
 	bool cbIterEnd() {
 		rsme_err=rmse();
+		if (stop) {
+			msg(1, "RMSE = "<<rsme_err<<"\n    Cancelled!\n");
+			return true;
+		}
 		msg(1, "RMSE = "<<rsme_err << "Other values:" << (rsme_err<prevErr*(1+weightEps)) << ((prevErr-rsme_err)<tolerance*prevErr) << "\n");
 		if ((rsme_err<prevErr*(1+weightEps))&&((prevErr-rsme_err)<tolerance*prevErr)) {
 			np--;
@@ -77,12 +189,16 @@ public:
 
 	bool cbTransformationsIterEnd() {
 		msg(1, ".");
-		return false;
+		return stop;
 	}
 
 	bool cbWeightsIterEnd() {
 		msg(1, ".");
-		return false;
+		return stop;
+	}
+
+	void cbTiming(const string& name, double seconds) {
+		timings[name]+=seconds;
 	}
 
 	bool writeFBX(string outFile){
@@ -90,26 +206,77 @@ public:
 		return writeFBXs(outFile, *this);
 	}
 
-	void load_data(MatrixX vert_data,vector< vector<int> > face_data){
+	//! Load the sequence, float32 C- or F-contiguous arrays are referenced instead of copied, other dtypes (e.g. float64) are converted once, and faces as an (nP, k) int array
+	void load_data(pybind11::array_t<float, pybind11::array::forcecast> vert_data,pybind11::array_t<int, pybind11::array::c_style|pybind11::array::forcecast> face_data){
+		load_data_polygons(vert_data,readNumpyFaces(face_data));
+	}
 
+	//! Load the sequence and faces as a list of polygons of any sizes
+	void load_data_polygons(pybind11::array_t<float, pybind11::array::forcecast> vert_data,const vector< vector<int> >& face_data){
+		checkIdle();
 		clear(); // Remove all previous data 
 
 		// # Check if output and input is provided
-		msg(1, "Reading Numpy array Rows:" << vert_data.rows() << "Vertices:" << vert_data.cols());
+		msg(1, "Reading Numpy array Rows:" << vert_data.shape(0) << "Vertices:" << (vert_data.ndim()>1?vert_data.shape(1):0));
 		readNumpy(vert_data,face_data,*this);
 		return;
 
 	}	
 
+	bool load_stream(string fileName,vector< vector<int> > face_data){
+		checkIdle();
+		clear(); // Remove all previous data 
+
+		msg(1, "Streaming frames from:" << fileName << "\n");
+		return readNumpyStream(fileName,face_data,*this);
+
+	}
+
+	//! Solve with the GIL released, then return (w, m, rmse), or an empty tuple if the output file cannot be written
 	pybind11::tuple run_ssdr(int init_bones=30,string outFile=""){
+		checkIdle();
+		bool ok;
+		{
+			pybind11::gil_scoped_release release;
+			stop=false;
+			ok=solve(init_bones, outFile);
+		}
+		return ok?results():pybind11::make_tuple();
+	}
 
+	//! Start run_ssdr() in a background thread and return its AsyncRun handle, the solver is busy until the handle is done()
+	AsyncRun* run_ssdr_async(int init_bones=30,string outFile=""){
+		checkIdle();
+		stop=false;
+		busy=true;
+		try {
+			return new AsyncRun(std::async(std::launch::async, [this, init_bones, outFile]() {
+				struct Idle { std::atomic<bool>& busy; ~Idle() { busy=false; } } idle{busy};
+				return solve(init_bones, outFile);
+			}), stop, [this](){ return results(); });
+		} catch (...) {
+			busy=false;
+			throw;
+		}
+	}
 
+	//! @return (w, m, rmse) owning copies of w and m, so they stay valid when the solver frees or resizes them
+	pybind11::tuple results() {
+		return pybind11::make_tuple(w_copy(),copy(m),this->rsme_err);
+	}
 
+	/** Initialize the bones if there are none, run the decomposition and write the output file, does not need the GIL
+		@return false if the output file cannot be written
+	*/
+	bool solve(int init_bones, string outFile){
 		msg(1, "Parameters:\n");
 
 		msg(1, "    nInitIters         = "<< nInitIters << "\n");
 
 		msg(1, "    nIters             = "<< nIters << "\n");
+		msg(1, "    multiLevels        = "<< multiLevels << "\n");
+		msg(1, "    levelIters         = "<< levelIters << "\n");
+		msg(1, "    repFrames          = "<< repFrames << "\n");
 		msg(1, "    tolerance          = "<< tolerance << "\n");
 		msg(1, "    patience           = "<< patience << "\n");
 
@@ -131,9 +298,11 @@ public:
 
 		if (nB==0) {
 			nB = init_bones;
-			msg(1, "Initializing bones:" << nB);
-			init();
-			msg(1, "\n");
+			if ((multiLevels==0)&&(repFrames==0)) { // compute() initializes the bones on the coarse levels or the representative frames otherwise
+				msg(1, "Initializing bones:" << nB);
+				init();
+				msg(1, "\n");
+			}
 		}
 		msg(1, "    nBones (target)    = "<< nB <<"\n");
 
@@ -141,8 +310,69 @@ public:
 		
 		compute();
 
-		if (!writeFBX(outFile) and outFile!="") return pybind11::make_tuple();
-		return pybind11::make_tuple(this->w,this->m,this->rsme_err);
+		return writeFBX(outFile) or outFile=="";
+	}
+
+	/** @return numpy array viewing the dense matrix (or vector) @p a without copy
+		@details The array keeps this solver alive, it is invalidated when the solver resizes @p a, e.g. when the number of bones changes.
+	*/
+	template<class Derived>
+	pybind11::array view(Eigen::PlainObjectBase<Derived>& a) {
+		return wrap(a, pybind11::cast(this, pybind11::return_value_policy::reference));
+	}
+
+	//! @return one-dimensional numpy array viewing @p n values at @p p without copy, see view()
+	template<class T>
+	pybind11::array view(T* p, Eigen::Index n) {
+		return pybind11::array_t<T>({n}, {sizeof(T)}, p, pybind11::cast(this, pybind11::return_value_policy::reference));
+	}
+
+	//! @return numpy array owning a copy of the dense matrix (or vector) @p a, freed with the array
+	template<class Derived>
+	static pybind11::array copy(const Eigen::PlainObjectBase<Derived>& a) {
+		Derived* c=new Derived(a);
+		return wrap(*c, pybind11::capsule(c, [](void* p) { delete (Derived*)p; }));
+	}
+
+	//! @return (indptr, indices, data) numpy arrays viewing the compressed sparse column storage of w, see view()
+	pybind11::tuple w_csc() {
+		w.makeCompressed();
+		this->wmDirty=true; // The arrays are writable
+		return csc(w, pybind11::cast(this, pybind11::return_value_policy::reference));
+	}
+
+	//! @return scipy.sparse.csc_matrix sharing the arrays of w_csc()
+	pybind11::object w_view() {
+		return cscMatrix(w_csc(), w);
+	}
+
+	//! @return scipy.sparse.csc_matrix owning a copy of w, freed with the matrix
+	pybind11::object w_copy() {
+		SparseMatrix* c=new SparseMatrix(w);
+		c->makeCompressed();
+		return cscMatrix(csc(*c, pybind11::capsule(c, [](void* p) { delete (SparseMatrix*)p; })), *c);
+	}
+
+	//! @return numpy array of the dense matrix (or vector) @p a, whose memory is kept alive by @p base
+	template<class Derived>
+	static pybind11::array wrap(Eigen::PlainObjectBase<Derived>& a, pybind11::handle base) {
+		using T=typename Derived::Scalar;
+		if (Derived::ColsAtCompileTime==1) return pybind11::array_t<T>({a.size()}, {sizeof(T)}, a.data(), base);
+		return pybind11::array_t<T>({a.rows(), a.cols()}, {sizeof(T), sizeof(T)*a.rows()}, a.data(), base);
+	}
+
+	//! @return (indptr, indices, data) numpy arrays of the compressed sparse matrix @p a, whose memory is kept alive by @p base
+	static pybind11::tuple csc(SparseMatrix& a, pybind11::handle base) {
+		using Index=typename SparseMatrix::StorageIndex;
+		using T=typename SparseMatrix::Scalar;
+		return pybind11::make_tuple(pybind11::array_t<Index>({a.outerSize()+1}, {sizeof(Index)}, a.outerIndexPtr(), base),
+			pybind11::array_t<Index>({a.nonZeros()}, {sizeof(Index)}, a.innerIndexPtr(), base), pybind11::array_t<T>({a.nonZeros()}, {sizeof(T)}, a.valuePtr(), base));
+	}
+
+	//! @return scipy.sparse.csc_matrix of the arrays @p arrays returned by csc() for the matrix @p a
+	static pybind11::object cscMatrix(pybind11::tuple arrays, const SparseMatrix& a) {
+		return pybind11::module::import("scipy.sparse").attr("csc_matrix")(pybind11::make_tuple(arrays[2], arrays[1], arrays[0]),
+			pybind11::arg("shape")=pybind11::make_tuple(a.rows(), a.cols()), pybind11::arg("copy")=false);
 	}
 
 
@@ -152,74 +382,146 @@ private:
 };
 
 
-PYBIND11_MODULE(pyssdr, handle){
-	handle.doc() = "Python Wrapper for SSDR\nDem Bones - (c) Electronic Arts 2019\n - This tool only handles clean input data, i.e. only one piece of geometry with one skinCluster and no excessive joint.\n\
-     - To hard-lock the transformations of bones: in the input fbx files, create bool attributes for joint nodes (bones) with name \"demLock\" and set the value to \"true\".\n\
-     - To soft-lock skinning weights of vertices: in the input fbx files, paint per-vertex colors in gray-scale. The closer the color to white, the more skinning weights of the vertex are preserved.", '=', "1.2.0";
+/** Decompose a batch of meshes concurrently with BatchScheduler
+	@param jobs is a list of (vertices, faces) or (vertices, faces, parameters) tuples, parameters is a dict of solver attributes,
+	with the extra keys "init_bones" and "outFile" of run_ssdr()
+	@param nThreads is the total number of threads, 0 = all
+	@param costPerThread is the number of vertices times frames worth one thread
+	@return the list of run_ssdr() results
+*/
+template<class MyDemBones>
+pybind11::list runBatch(pybind11::list jobs, int nThreads, double costPerThread) {
+	int n=(int)jobs.size();
+	vector<pybind11::object> owner(n);
+	vector<MyDemBones*> solver(n);
+	vector<int> initBones(n, 30);
+	vector<string> outFile(n);
+	vector<double> cost(n);
+
+	for (int i=0; i<n; i++) {
+		pybind11::tuple job=jobs[i].cast<pybind11::tuple>();
+		owner[i]=pybind11::cast(new MyDemBones(), pybind11::return_value_policy::take_ownership);
+		solver[i]=owner[i].cast<MyDemBones*>();
+		owner[i].attr("load_data")(job[0], job[1]);
+		if (job.size()>2) for (auto p: job[2].cast<pybind11::dict>()) {
+			string key=p.first.cast<string>();
+			if (key=="init_bones") initBones[i]=p.second.cast<int>();
+			else if (key=="outFile") outFile[i]=p.second.cast<string>();
+			else pybind11::setattr(owner[i], p.first, p.second);
+		}
+		cost[i]=double(solver[i]->nV)*solver[i]->nF;
+	}
 
+	vector<char> ok(n, 0);
+	{
+		pybind11::gil_scoped_release release;
+		BatchScheduler scheduler(nThreads);
+		scheduler.costPerThread=costPerThread;
+		scheduler.run(cost, [&](int i, int nt) {
+			solver[i]->stop=false;
+			ok[i]=solver[i]->solve(initBones[i], outFile[i]);
+		});
+	}
+
+	pybind11::list res;
+	for (int i=0; i<n; i++) res.append(ok[i]?solver[i]->results():pybind11::make_tuple());
+	return res;
+}
+
+/** Bind a solver class to the module
+	@param name is the Python class name
+*/
+template<class MyDemBones>
+void bindDemBones(pybind11::module& handle, const char* name) {
 	pybind11::class_<MyDemBones>(
-		handle,"MyDemBones"
+		handle, name
 		)
 	.def(pybind11::init<>())
 	.def("load_data",&MyDemBones::load_data)
-	.def("run_ssdr",&MyDemBones::run_ssdr)
+	.def("load_data",&MyDemBones::load_data_polygons)
+	.def("load_stream",&MyDemBones::load_stream)
+	.def("run_ssdr",&MyDemBones::run_ssdr,pybind11::arg("init_bones")=30,pybind11::arg("outFile")="")
+	.def_static("run_batch",&runBatch<MyDemBones>,pybind11::arg("jobs"),pybind11::arg("nThreads")=0,pybind11::arg("costPerThread")=1e6)
+	// The handle keeps the solver alive
+	.def("run_ssdr_async",&MyDemBones::run_ssdr_async,pybind11::arg("init_bones")=30,pybind11::arg("outFile")="",pybind11::keep_alive<0, 1>())
 	// Hyperparmaters
-	.def_readwrite("weightsSmoothStep",&MyDemBones::weightsSmoothStep)
-	.def_readwrite("weightsSmooth",&MyDemBones::weightsSmooth)
-	.def_readwrite("nnz",&MyDemBones::nnz)
-	.def_readwrite("nWeightsIters",&MyDemBones::nWeightsIters)
-
-	.def_readwrite("transAffineNorm",&MyDemBones::transAffineNorm)
-	.def_readwrite("transAffine",&MyDemBones::transAffine)
-	.def_readwrite("bindUpdate",&MyDemBones::bindUpdate)
-	.def_readwrite("nTransIters",&MyDemBones::nTransIters)
-
-	.def_readwrite("patience",&MyDemBones::patience)
-	.def_readwrite("tolerance",&MyDemBones::tolerance)
-
-	.def_readwrite("nIters",&MyDemBones::nIters)
-	.def_readwrite("nInitIters",&MyDemBones::nInitIters)
-
-	.def_readwrite("nB",&MyDemBones::nB)
-	.def_readwrite("nV",&MyDemBones::nV)
-	.def_readwrite("nF",&MyDemBones::nF)
+	.def_property("weightsSmoothStep",MyDemBones::getter(&MyDemBones::weightsSmoothStep),MyDemBones::setter(&MyDemBones::weightsSmoothStep))
+	.def_property("weightsSmooth",MyDemBones::getter(&MyDemBones::weightsSmooth),MyDemBones::setter(&MyDemBones::weightsSmooth))
+	.def_property("weightsSmoothRings",MyDemBones::getter(&MyDemBones::weightsSmoothRings),MyDemBones::setter(&MyDemBones::weightsSmoothRings))
+	.def_property("smoothCacheDir",MyDemBones::getter(&MyDemBones::smoothCacheDir),MyDemBones::setter(&MyDemBones::smoothCacheDir))
+	.def_property("nnz",MyDemBones::getter(&MyDemBones::nnz),MyDemBones::setter(&MyDemBones::nnz))
+	.def_property("nCandBones",MyDemBones::getter(&MyDemBones::nCandBones),MyDemBones::setter(&MyDemBones::nCandBones))
+	.def_property("nWeightsIters",MyDemBones::getter(&MyDemBones::nWeightsIters),MyDemBones::setter(&MyDemBones::nWeightsIters))
+
+	.def_property("transAffineNorm",MyDemBones::getter(&MyDemBones::transAffineNorm),MyDemBones::setter(&MyDemBones::transAffineNorm))
+	.def_property("transAffine",MyDemBones::getter(&MyDemBones::transAffine),MyDemBones::setter(&MyDemBones::transAffine))
+	.def_property("vuTBlockSize",MyDemBones::getter(&MyDemBones::vuTBlockSize),MyDemBones::setter(&MyDemBones::vuTBlockSize))
+	.def_property("streamChunkSize",MyDemBones::getter(&MyDemBones::streamChunkSize),MyDemBones::setter(&MyDemBones::streamChunkSize))
+	.def_property("bindUpdate",MyDemBones::getter(&MyDemBones::bindUpdate),MyDemBones::setter(&MyDemBones::bindUpdate))
+	.def_property("nTransIters",MyDemBones::getter(&MyDemBones::nTransIters),MyDemBones::setter(&MyDemBones::nTransIters))
+
+	.def_property("patience",MyDemBones::getter(&MyDemBones::patience),MyDemBones::setter(&MyDemBones::patience))
+	.def_property("tolerance",MyDemBones::getter(&MyDemBones::tolerance),MyDemBones::setter(&MyDemBones::tolerance))
+
+	.def_property("nIters",MyDemBones::getter(&MyDemBones::nIters),MyDemBones::setter(&MyDemBones::nIters))
+	.def_property("multiLevels",MyDemBones::getter(&MyDemBones::multiLevels),MyDemBones::setter(&MyDemBones::multiLevels))
+	.def_property("levelIters",MyDemBones::getter(&MyDemBones::levelIters),MyDemBones::setter(&MyDemBones::levelIters))
+	.def_property("repFrames",MyDemBones::getter(&MyDemBones::repFrames),MyDemBones::setter(&MyDemBones::repFrames))
+	.def_property("nInitIters",MyDemBones::getter(&MyDemBones::nInitIters),MyDemBones::setter(&MyDemBones::nInitIters))
+	.def_property("initMethod",MyDemBones::getter(&MyDemBones::initMethod),MyDemBones::setter(&MyDemBones::initMethod))
+	.def_property("labelBuckets",MyDemBones::getter(&MyDemBones::labelBuckets),MyDemBones::setter(&MyDemBones::labelBuckets))
+
+	.def_property("nB",MyDemBones::getter(&MyDemBones::nB),MyDemBones::setter(&MyDemBones::nB))
+	.def_property("nV",MyDemBones::getter(&MyDemBones::nV),MyDemBones::setter(&MyDemBones::nV))
+	.def_property("nF",MyDemBones::getter(&MyDemBones::nF),MyDemBones::setter(&MyDemBones::nF))
 
 	// Data variables
-	.def_readwrite("w",&MyDemBones::w)
-	.def_readwrite("m",&MyDemBones::m)
-	.def_readwrite("keep_bones",&MyDemBones::keep_bones)
-	.def_readwrite("mTm",&MyDemBones::mTm)
-	.def_readwrite("label",&MyDemBones::label)
-	.def_readwrite("lockW",&MyDemBones::lockW)
-	.def_readwrite("lockM",&MyDemBones::lockM)
+	// Getters return views of the solver memory, valid until the solver resizes them
+	.def_property("w",MyDemBones::idle(&MyDemBones::w_view),[](MyDemBones& d, const typename MyDemBones::SparseMatrix& x){ d.checkIdle(); d.w=x; d.wmDirty=true; })
+	.def_property_readonly("w_csc",MyDemBones::idle(&MyDemBones::w_csc))
+	.def_property("m",[](MyDemBones& d){ d.checkIdle(); d.wmDirty=true; return d.view(d.m); },[](MyDemBones& d, const typename MyDemBones::MatrixX& x){ d.checkIdle(); d.m=x; d.wmDirty=true; })
+	.def_property("keep_bones",MyDemBones::getter(&MyDemBones::keep_bones),MyDemBones::setter(&MyDemBones::keep_bones))
+	.def_property("mTm",[](MyDemBones& d){ d.checkIdle(); return d.view(d.mTm); },[](MyDemBones& d, const typename MyDemBones::MatrixX& x){ d.checkIdle(); d.mTm=x; })
+	.def_property("label",[](MyDemBones& d){ d.checkIdle(); return d.view(d.label); },[](MyDemBones& d, const Eigen::VectorXi& x){ d.checkIdle(); d.label=x; })
+	.def_property("lockW",MyDemBones::getter(&MyDemBones::lockW),MyDemBones::setter(&MyDemBones::lockW))
+	.def_property("lockM",MyDemBones::getter(&MyDemBones::lockM),MyDemBones::setter(&MyDemBones::lockM))
+	.def_property("timings",MyDemBones::getter(&MyDemBones::timings),MyDemBones::setter(&MyDemBones::timings))
+	.def_readonly("weightsAllocs",&MyDemBones::weightsAllocs)
 
 	// Commands
-	.def("init",&MyDemBones::init)
-	.def("computeTransFromLabel",&MyDemBones::computeTransFromLabel)
-	.def("computeLabel",&MyDemBones::computeLabel)
-	.def("pruneBones",&MyDemBones::pruneBones)
-	.def("labelToWeights",&MyDemBones::labelToWeights)
-	.def("compute",&MyDemBones::compute)
-	.def("rmse",&MyDemBones::rmse)
-	.def("clear",&MyDemBones::clear)
-	.def("vertex_rmse",&MyDemBones::vertex_rmse)
-	.def("vertex_max_rmse",&MyDemBones::vertex_rmse)
-	.def("rmse_from_cluster",&MyDemBones::rmse_from_cluster)
-	.def("compute_reconstruction",&MyDemBones::compute_reconstruction)
-	.def("computeWeights",&MyDemBones::computeWeights)
-	.def("computeTranformations",&MyDemBones::computeTranformations)
-	.def("compute_errorVtxBoneALL",&MyDemBones::compute_errorVtxBoneALL)
-	.def("errorVtxBone",&MyDemBones::errorVtxBone)
+	.def("init",MyDemBones::idle(&MyDemBones::init))
+	.def("computeTransFromLabel",MyDemBones::idle(&MyDemBones::computeTransFromLabel))
+	.def("computeLabel",[](MyDemBones& d){ d.checkIdle(); d.computeLabel(); })
+	.def("pruneBones",MyDemBones::idle(&MyDemBones::pruneBones))
+	.def("labelToWeights",MyDemBones::idle(&MyDemBones::labelToWeights))
+	.def("compute",[](MyDemBones& d){ d.checkIdle(); d.stop=false; d.compute(); },pybind11::call_guard<pybind11::gil_scoped_release>())
+	.def("rmse",MyDemBones::idle(&MyDemBones::rmse),pybind11::arg("exact")=false)
+	.def("clear",MyDemBones::idle(&MyDemBones::clear))
+	.def("vertex_rmse",MyDemBones::idle(&MyDemBones::vertex_rmse))
+	.def("vertex_max_rmse",MyDemBones::idle(&MyDemBones::vertex_rmse))
+	.def("rmse_from_cluster",MyDemBones::idle(&MyDemBones::rmse_from_cluster))
+	.def("compute_reconstruction",[](MyDemBones& d, std::vector<int> vert_inds){ d.checkIdle(); return d.compute_reconstruction(vert_inds); },pybind11::arg("vert_inds"))
+	.def("compute_reconstruction",[](MyDemBones& d, std::vector<int> vert_inds, Eigen::Ref<typename MyDemBones::MatrixX> out){ d.checkIdle(); d.compute_reconstruction(vert_inds, out); },
+		pybind11::arg("vert_inds"),pybind11::arg("out"),"Write the reconstruction into out, a preallocated F-contiguous array of shape (3*nF, len(vert_inds))")
+	.def("computeWeights",[](MyDemBones& d){ d.checkIdle(); d.stop=false; d.computeWeights(); },pybind11::call_guard<pybind11::gil_scoped_release>())
+	.def("computeTranformations",[](MyDemBones& d){ d.checkIdle(); d.stop=false; d.computeTranformations(); },pybind11::call_guard<pybind11::gil_scoped_release>())
+	.def("compute_errorVtxBoneALL",MyDemBones::idle(&MyDemBones::compute_errorVtxBoneALL))
+	.def("errorVtxBone",MyDemBones::idle(&MyDemBones::errorVtxBone))
 	.def("cbIterEnd",&MyDemBones::cbIterEnd)
-	.def("writeFBX",&MyDemBones::writeFBX);
-
-
-
-
-
-
-
+	.def("writeFBX",MyDemBones::idle(&MyDemBones::writeFBX));
 }
 
+PYBIND11_MODULE(pyssdr, handle){
+	handle.doc() = "Python Wrapper for SSDR\nDem Bones - (c) Electronic Arts 2019\n - This tool only handles clean input data, i.e. only one piece of geometry with one skinCluster and no excessive joint.\n\
+     - To hard-lock the transformations of bones: in the input fbx files, create bool attributes for joint nodes (bones) with name \"demLock\" and set the value to \"true\".\n\
+     - To soft-lock skinning weights of vertices: in the input fbx files, paint per-vertex colors in gray-scale. The closer the color to white, the more skinning weights of the vertex are preserved.", '=', "1.2.0";
 
+	pybind11::class_<AsyncRun>(handle, "AsyncRun")
+	.def("done",&AsyncRun::done)
+	.def("cancel",&AsyncRun::cancel)
+	.def("cancelled",&AsyncRun::cancelled)
+	.def("result",&AsyncRun::result);
 
+	bindDemBones<MyDemBonesT<double>>(handle, "MyDemBones");
+	bindDemBones<MyDemBonesT<float>>(handle, "MyDemBonesF");
+}